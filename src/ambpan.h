@@ -30,50 +30,221 @@
 #ifndef AMBPAN_H
 #define AMBPAN_H
 
+#include <algorithm>
+#include <math.h>
+#include <stdint.h>
+
 #define MIN3DB 0.707107f
 
+// number of samples processed at once by ambpan_t::add():
+#define AMBPAN_CHUNK 64
+
 namespace HoS {
 
   /**
-     \brief 3rd order horizontal ambisonics panner
+     \brief Horizontal ambisonics coefficients
+     \param order Ambisonics order
+     \param az Azimuth (radiants)
+     \param el Pseudo-elevation (radiants)
+     \param c Output, 2*order+1 coefficients (W, X, Y, U, V, P, Q, ...)
+
+     The pseudo-elevation fades the directional components towards W
+     and raises the overall gain by up to 3 dB.
+  */
+  inline void amb_coeff_2d(uint32_t order, float az, float el, float* c)
+  {
+    float t(cosf(el));
+    const float gain(2.0f - fabsf(t));
+    // powers of (x+iy) give the cosine and sine terms of each order:
+    const float x(t * cosf(az));
+    const float y(t * sinf(az));
+    float re(1.0f);
+    float im(0.0f);
+    c[0] = gain * MIN3DB;
+    for(uint32_t m = 1; m <= order; ++m) {
+      t = re * x - im * y;
+      im = re * y + im * x;
+      re = t;
+      c[2 * m - 1] = gain * re;
+      c[2 * m] = gain * im;
+    }
+  }
+
+  /**
+     \brief Real spherical harmonics in ACN order with SN3D
+     normalization
+     \param order Ambisonics order
+     \param az Azimuth (radiants)
+     \param el Elevation (radiants)
+     \param c Output, (order+1)^2 coefficients
+  */
+  inline void amb_coeff_3d(uint32_t order, float az, float el, float* c)
+  {
+    const double x(sin(el));
+    const double ct(cos(el));
+    // associated Legendre functions without Condon-Shortley phase:
+    double pmm(1.0);
+    for(uint32_t m = 0; m <= order; ++m) {
+      if(m > 0)
+        pmm *= (2.0 * m - 1.0) * ct;
+      const double cm(cos(m * az));
+      const double sm(sin(m * az));
+      double plm1(0.0);
+      double plm(pmm);
+      for(uint32_t l = m; l <= order; ++l) {
+        if(l > m) {
+          double pn(((2.0 * l - 1.0) * x * plm - (l + m - 1.0) * plm1) /
+                    (l - m));
+          plm1 = plm;
+          plm = pn;
+        }
+        // (l-m)!/(l+m)!:
+        double fr(1.0);
+        for(uint32_t j = l - m + 1; j <= l + m; ++j)
+          fr /= j;
+        const double nrm(sqrt(((m > 0) ? 2.0 : 1.0) * fr) * plm);
+        c[l * l + l + m] = nrm * cm;
+        if(m > 0)
+          c[l * l + l - m] = nrm * sm;
+      }
+    }
+  }
+
+  /**
+     \brief Ambisonics panner of arbitrary order
+
+     The horizontal panner (b3d = false) uses the channel order W,
+     X, Y, U, V, P, Q, ..., and a pseudo-elevation, see amb_coeff_2d().
+     The full sphere panner (b3d = true) uses ACN channel order and
+     SN3D normalization, see amb_coeff_3d().
+
+     The coefficients, including the gain, are ramped linearly
+     between two calls of set(). The number of channels is a compile
+     time constant, so the loops across channels are unrolled and
+     vectorised by the compiler.
+
+     \tparam order Ambisonics order
+     \tparam b3d Full sphere (true) or horizontal (false)
   */
-  class amb_coeff {
+  template <uint32_t order, bool b3d = false> class ambpan_t {
   public:
+    enum { channels = (b3d ? (order + 1) * (order + 1) : 2 * order + 1) };
     /**
        \param dt update time interval
     */
-    amb_coeff(unsigned int dt)
-        : dt1(1.0f / (float)dt), g(0.0f), x(0.0f), y(0.0f), u(0.0f), v(0.0f),
-          p(0.0f), q(0.0f)
+    ambpan_t(unsigned int dt) : dt1(1.0f / (float)dt)
     {
-      set(0.0f, 0.0f, 0.0f);
+      for(uint32_t k = 0; k < channels; ++k) {
+        w[k] = 0.0f;
+        dw[k] = 0.0f;
+      }
     };
     /**
-       \brief Set panning parameters
+       \brief Set panning parameters, to be reached after dt samples
        \param az Azimuth (radiants)
-       \param el Pseudo-elevation (radiants)
+       \param el Elevation (radiants)
        \param gain Linear broadband gain
     */
     void set(float az, float el, float gain)
     {
-      float _t(cosf(el));
-      gain *= 2.0f - fabsf(_t);
-      float _x(_t * cosf(az));
-      float _y(_t * sinf(az));
-      float _x2(_x * _x);
-      float _y2(_y * _y);
-      float _u(_x2 - _y2);
-      float _v(2.0f * _x * _y);
-      float _p((_x2 - 3.0f * _y2) * _x);
-      float _q((3.0f * _x2 - _y2) * _y);
-      dg = (gain - g) * dt1;
-      dx = (_x - x) * dt1;
-      dy = (_y - y) * dt1;
-      du = (_u - u) * dt1;
-      dv = (_v - v) * dt1;
-      dp = (_p - p) * dt1;
-      dq = (_q - q) * dt1;
+      float c[channels];
+      coeff(az, el, gain, c);
+      set(c);
+    };
+    /**
+       \brief Set target coefficients, to be reached after dt samples
+       \param c Coefficients, e.g., computed by coeff()
+    */
+    void set(const float* c)
+    {
+      for(uint32_t k = 0; k < channels; ++k)
+        dw[k] = (c[k] - w[k]) * dt1;
+    };
+    /**
+       \brief Compute panning coefficients, including the gain
+       \param az Azimuth (radiants)
+       \param el Elevation (radiants)
+       \param gain Linear broadband gain
+       \param c Output, channels coefficients
+    */
+    static void coeff(float az, float el, float gain, float* c)
+    {
+      if(b3d)
+        amb_coeff_3d(order, az, el, c);
+      else
+        amb_coeff_2d(order, az, el, c);
+      for(uint32_t k = 0; k < channels; ++k)
+        c[k] *= gain;
+    };
+    /**
+       \brief Apply panning to one time frame
+       \param t Input sample
+       \param out Output frame, the panned signal is added
+    */
+    inline void add(float t, float* out)
+    {
+      for(uint32_t k = 0; k < channels; ++k)
+        out[k] += t * (w[k] += dw[k]);
+    };
+    /**
+       \brief Apply panning to a block of samples
+
+       Same as n calls of add(float,float*), but the ramped
+       coefficients are computed from the sample index instead of
+       being accumulated. The input and the input weighted with the
+       sample index are computed once per chunk, so the loop across
+       channels costs two multiply-adds per sample and channel, and
+       is vectorised.
+
+       \param in Input signal
+       \param n Number of samples
+       \param out Output channels, the panned signal is added
+       \param gin Additional linear input gain
+    */
+    void add(const float* in, uint32_t n, float* const* out, float gin = 1.0f)
+    {
+      float x[AMBPAN_CHUNK];
+      float xt[AMBPAN_CHUNK];
+      for(uint32_t i0 = 0; i0 < n; i0 += AMBPAN_CHUNK) {
+        const uint32_t nc(std::min((uint32_t)AMBPAN_CHUNK, n - i0));
+        for(uint32_t i = 0; i < nc; ++i) {
+          x[i] = gin * in[i0 + i];
+          xt[i] = x[i] * (float)(i + 1);
+        }
+        for(uint32_t k = 0; k < channels; ++k) {
+          float* o(out[k] + i0);
+          const float c(w[k]);
+          const float dc(dw[k]);
+          for(uint32_t i = 0; i < nc; ++i)
+            o[i] += x[i] * c + xt[i] * dc;
+          w[k] += nc * dc;
+        }
+      }
     };
+    /**
+       \brief Clear one output frame
+    */
+    static void clear(float* out)
+    {
+      for(uint32_t k = 0; k < channels; ++k)
+        out[k] = 0.0f;
+    };
+
+  protected:
+    float dt1;
+    float w[channels];
+    float dw[channels];
+  };
+
+  /**
+     \brief 3rd order horizontal ambisonics panner
+  */
+  class amb_coeff : public ambpan_t<3> {
+  public:
+    /**
+       \param dt update time interval
+    */
+    amb_coeff(unsigned int dt) : ambpan_t<3>(dt){};
     /**
         \brief Apply panning to one time frame
 
@@ -89,14 +260,26 @@ namespace HoS {
     inline void addpan30(float t, float& W, float& X, float& Y, float& U,
                          float& V, float& P, float& Q)
     {
-      t *= (g += dg);
-      W += t * MIN3DB;
-      X += t * (x += dx);
-      Y += t * (y += dy);
-      U += t * (u += du);
-      V += t * (v += dv);
-      P += t * (p += dp);
-      Q += t * (q += dq);
+      W += t * (w[0] += dw[0]);
+      X += t * (w[1] += dw[1]);
+      Y += t * (w[2] += dw[2]);
+      U += t * (w[3] += dw[3]);
+      V += t * (w[4] += dw[4]);
+      P += t * (w[5] += dw[5]);
+      Q += t * (w[6] += dw[6]);
+    };
+    /**
+       \brief Apply panning to a block of samples
+       \param in Input signal
+       \param n Number of samples
+       \param out Seven output channels (W, X, Y, U, V, P, Q), the
+       panned signal is added
+       \param gin Additional linear input gain
+    */
+    void addpan30(const float* in, uint32_t n, float* const* out,
+                  float gin = 1.0f)
+    {
+      add(in, n, out, gin);
     };
     /**
        \brief Clear components of one frame
@@ -119,11 +302,6 @@ namespace HoS {
       P = 0.0f;
       Q = 0.0f;
     }
-
-  private:
-    float dt1;
-    float g, x, y, u, v, p, q;
-    float dg, dx, dy, du, dv, dp, dq;
   };
 
 } // namespace HoS
@@ -0,0 +1,268 @@
+/**
+   \file fastmath.h
+   \brief Fast approximations of elementary functions for spectral processing
+
+   All functions are branch-free, so that loops over arrays can be
+   vectorized by the compiler (with -O3 -ffast-math). The maximum
+   errors given in the function descriptions were measured with
+   test_fastmath.cc.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+  USA.
+
+*/
+#ifndef FASTMATH_H
+#define FASTMATH_H
+
+#include <algorithm>
+#include <complex>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+namespace HoS {
+
+  namespace fastmath {
+
+    inline float bits2float(int32_t i)
+    {
+      float f;
+      memcpy(&f, &i, sizeof(f));
+      return f;
+    }
+
+    inline int32_t float2bits(float f)
+    {
+      int32_t i;
+      memcpy(&i, &f, sizeof(i));
+      return i;
+    }
+
+    /**
+       \brief Round to nearest integer (half away from zero)
+    */
+    inline float round(float x)
+    {
+      return (float)(int32_t)(x + copysignf(0.5f, x));
+    }
+
+  } // namespace fastmath
+
+  /**
+     \brief Four-quadrant arc tangent
+
+     Maximum absolute error 1.2e-5 rad.
+   */
+  inline float fast_atan2f(float y, float x)
+  {
+    float ax(fabsf(x));
+    float ay(fabsf(y));
+    float mx(std::max(ax, ay));
+    float mn(std::min(ax, ay));
+    float a(mn / (mx + 1e-30f));
+    float s(a * a);
+    // Abramowitz and Stegun 4.4.49:
+    float r(a * (0.9998660f +
+                 s * (-0.3302995f +
+                      s * (0.1801410f + s * (-0.0851330f + s * 0.0208351f)))));
+    r = (ay > ax) ? (1.57079633f - r) : r;
+    r = (x < 0.0f) ? (3.14159265f - r) : r;
+    return copysignf(r, y);
+  }
+
+  /**
+     \brief Phase of a complex number, replacement for std::arg
+   */
+  inline float fast_arg(const std::complex<float>& x)
+  {
+    return fast_atan2f(x.imag(), x.real());
+  }
+
+  /**
+     \brief Base-2 exponential
+
+     Maximum relative error 2.5e-7. Arguments are clamped to
+     [-126,127].
+   */
+  inline float fast_exp2f(float x)
+  {
+    x = std::min(127.0f, std::max(-126.0f, x));
+    // split into integer part and fraction in [-0.5,0.5]:
+    float fi(fastmath::round(x));
+    int32_t i((int32_t)fi);
+    float f(x - fi);
+    float p(
+        1.0f +
+        f * (0.693147182f +
+             f * (0.240226507f +
+                  f * (0.0555041087f +
+                       f * (0.00961812911f +
+                            f * (0.00133335581f + f * 0.000154035304f))))));
+    return p * fastmath::bits2float((i + 127) << 23);
+  }
+
+  /**
+     \brief Natural exponential
+
+     Maximum relative error 2.5e-7 for arguments in [-1,1], growing
+     to 4e-6 at |x|=87 due to rounding of the scaled argument.
+   */
+  inline float fast_expf(float x)
+  {
+    return fast_exp2f(1.44269504f * x);
+  }
+
+  /**
+     \brief Base-2 logarithm
+
+     Maximum absolute error 5e-7 for normalized positive arguments.
+     Zero, negative and denormalized arguments return approximately
+     -127.
+   */
+  inline float fast_log2f(float x)
+  {
+    int32_t bits(fastmath::float2bits(x));
+    int32_t e(((bits >> 23) & 0xff) - 127);
+    // mantissa in [1,2):
+    float m(fastmath::bits2float((bits & 0x007fffff) | 0x3f800000));
+    // move mantissa to [sqrt(0.5),sqrt(2)):
+    bool big(m > 1.41421356f);
+    m = big ? 0.5f * m : m;
+    e += big;
+    float t((m - 1.0f) / (m + 1.0f));
+    float t2(t * t);
+    float p(t * (2.88539008f +
+                 t2 * (0.961796694f +
+                       t2 * (0.577078016f + t2 * 0.412198583f))));
+    return (float)e + p;
+  }
+
+  /**
+     \brief Sine and cosine
+
+     Maximum absolute error 2e-7 for arguments in [-pi,pi]. The range
+     reduction adds an error of about 7e-8*|x|.
+   */
+  inline void fast_sincosf(float x, float& s, float& c)
+  {
+    // reduce to [-pi,pi]:
+    float r(x - 6.28318531f * fastmath::round(0.159154943f * x));
+    // reduce to [-pi/2,pi/2]:
+    bool flip(fabsf(r) > 1.57079633f);
+    r = flip ? (copysignf(3.14159265f, r) - r) : r;
+    float r2(r * r);
+    s = r * (1.0f +
+             r2 * (-1.66666667e-1f +
+                   r2 * (8.33333333e-3f +
+                         r2 * (-1.98412698e-4f +
+                               r2 * (2.75573192e-6f + r2 * -2.50521084e-8f)))));
+    c = 1.0f +
+        r2 * (-0.5f +
+              r2 * (4.16666667e-2f +
+                    r2 * (-1.38888889e-3f +
+                          r2 * (2.48015873e-5f +
+                                r2 * (-2.75573192e-7f +
+                                      r2 * 2.08767570e-9f)))));
+    c = flip ? -c : c;
+  }
+
+  /**
+     \brief Unit phasor exp(i*x)
+   */
+  inline std::complex<float> fast_cis(float x)
+  {
+    float s, c;
+    fast_sincosf(x, s, c);
+    return std::complex<float>(c, s);
+  }
+
+  /**
+     \brief Array versions of the approximations
+
+     Input and output arrays may be identical, but must not overlap
+     otherwise.
+   */
+  namespace fastmath {
+
+    /**
+       \brief Phase of complex numbers, out[k] = arg(x[k])
+    */
+    inline void arg(const std::complex<float>* x, float* out, uint32_t n)
+    {
+      const float* xf((const float*)x);
+      for(uint32_t k = 0; k < n; ++k)
+        out[k] = fast_atan2f(xf[2 * k + 1], xf[2 * k]);
+    }
+
+    /**
+       \brief Magnitude of complex numbers, out[k] = |x[k]|
+    */
+    inline void abs(const std::complex<float>* x, float* out, uint32_t n)
+    {
+      const float* xf((const float*)x);
+      for(uint32_t k = 0; k < n; ++k)
+        out[k] = sqrtf(xf[2 * k] * xf[2 * k] + xf[2 * k + 1] * xf[2 * k + 1]);
+    }
+
+    /**
+       \brief out[k] = atan2(y[k],x[k])
+    */
+    inline void atan2(const float* y, const float* x, float* out, uint32_t n)
+    {
+      for(uint32_t k = 0; k < n; ++k)
+        out[k] = fast_atan2f(y[k], x[k]);
+    }
+
+    /**
+       \brief out[k] = exp(x[k])
+    */
+    inline void exp(const float* x, float* out, uint32_t n)
+    {
+      for(uint32_t k = 0; k < n; ++k)
+        out[k] = fast_expf(x[k]);
+    }
+
+    /**
+       \brief out[k] = log2(x[k])
+    */
+    inline void log2(const float* x, float* out, uint32_t n)
+    {
+      for(uint32_t k = 0; k < n; ++k)
+        out[k] = fast_log2f(x[k]);
+    }
+
+    /**
+       \brief Unit phasors, out[k] = exp(i*x[k])
+    */
+    inline void cis(const float* x, std::complex<float>* out, uint32_t n)
+    {
+      float* of((float*)out);
+      for(uint32_t k = 0; k < n; ++k)
+        fast_sincosf(x[k], of[2 * k + 1], of[2 * k]);
+    }
+
+  } // namespace fastmath
+
+} // namespace HoS
+
+#endif
+
+/*
+ * Local Variables:
+ * mode: c++
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * compile-command: "make -C .."
+ * End:
+ */
@@ -2,27 +2,28 @@
 #include <math.h>
 
 gammatone_t::gammatone_t(double f, double bw, double fs, uint32_t order_)
-    : state(0), order(order_)
+    : state(order_, 0.0f)
 {
   // filter design after: V. Hohmann (2002). Frequency analysis and
   // synthesis using a Gammatone filterbank. Acta Acustica united with
   // Acustica vol. 88
-  float u = pow(2.0, -1.0 / order);
-  float ct = cos(M_PI * bw / fs);
-  float ct2 = ct * ct;
-  float lambda =
+  // in double precision, 1-lambda is small for narrow bands:
+  double u = pow(2.0, -1.0 / order_);
+  double ct = cos(M_PI * bw / fs);
+  double ct2 = ct * ct;
+  double lambda =
       (sqrt((ct2 - 1.0) * u * u + (2.0 - 2.0 * ct) * u) + ct * u - 1.0) /
       (u - 1.0);
-  A = lambda * cexp(I * M_PI * f / fs);
-  B = pow(2.0, 1.0 / order) * (1.0 - cabs(A));
+  A = std::polar((float)lambda, (float)(2.0 * M_PI * f / fs));
+  B = pow(2.0, 1.0 / order_) * (1.0 - lambda);
 }
 
-float complex gammatone_t::filter(float complex x)
+std::complex<float> gammatone_t::filter(std::complex<float> x)
 {
-  for(uint32_t o = 0; o < order; o++) {
-    state *= A;
-    state += B * x;
-    x = state;
+  for(auto& s : state) {
+    s *= A;
+    s += B * x;
+    x = s;
   }
   return x;
 }
@@ -1,19 +1,25 @@
 #ifndef GAMMATONE_H
 #define GAMMATONE_H
 
-#include <complex.h>
+#include <complex>
 #include <stdint.h>
+#include <vector>
 
+/**
+   \brief Single complex gammatone filter
+
+   For banks of many filters, use HoS::gammatone_bank_t, which
+   processes blocks and several bands in parallel.
+ */
 class gammatone_t {
 public:
   gammatone_t(double f, double bw, double fs, uint32_t order);
-  float complex filter(float complex x);
+  std::complex<float> filter(std::complex<float> x);
 
 private:
-  float complex A;
+  std::complex<float> A;
   float B;
-  float complex state;
-  uint32_t order;
+  std::vector<std::complex<float>> state;
 };
 
 #endif
@@ -131,6 +131,8 @@ private:
   int32_t get_key() const;
   int32_t get_mode() const;
   void process_time();
+  void process_tick(double dtime);
+  void bundle_add(const char* path, lo_message msg);
   void read_xml(const std::string& fname);
   static int osc_set_pitch(const char* path, const char* types, lo_arg** argv,
                            int argc, lo_message msg, void* user_data);
@@ -143,6 +145,7 @@ private:
   pmf_t ptimesig;
   pmf_t ptimesigbars;
   lo_address lo_addr;
+  lo_bundle bundle = NULL; ///< OSC bundle collecting all messages of one tick
   uint32_t timesigcnt;
   std::vector<float> pcenter;
   std::vector<float> pbandw;
@@ -314,25 +317,59 @@ bool composer_t::process_timesig()
 
 /**
  * @brief Main composition callback, called every 1/64 note
+ *
+ * All messages of one tick are collected in a single OSC bundle,
+ * which is sent at the end of the tick. This reduces the number of
+ * UDP packets, and receivers get all events of a tick at once. The
+ * bundle is tagged "immediate": a timetag from the local clock would
+ * make receivers on other machines hold it back by the clock skew.
+ *
+ * The bundle and its messages are created for each tick and freed
+ * after sending, since the number and types of messages differ from
+ * tick to tick, and a liblo bundle can not drop messages for reuse.
+ * This runs in the composition thread, not in an audio callback.
  */
 void composer_t::process_time()
 {
-  double dtime(time / 64.0);
+  bundle = lo_bundle_new(LO_TT_IMMEDIATE);
+  process_tick(time / 64.0);
+  if(lo_bundle_count(bundle))
+    lo_send_bundle(lo_addr, bundle);
+  lo_bundle_free_recursive(bundle);
+  bundle = NULL;
+  ++time;
+}
+
+/**
+ * @brief Add a message to the bundle of the current tick
+ *
+ * The bundle takes ownership of the message.
+ */
+void composer_t::bundle_add(const char* path, lo_message msg)
+{
+  lo_bundle_add_message(bundle, path, msg);
+}
+
+void composer_t::process_tick(double dtime)
+{
+  lo_message msg;
   if((duration > 0) && (dtime > duration + 5.5))
     b_quit = true;
-  else
-    lo_send(lo_addr, "/time", "f", dtime);
-  if((duration > 0) && (dtime > duration)) {
-    ++time;
-    return;
+  else {
+    msg = lo_message_new();
+    lo_message_add_float(msg, dtime);
+    bundle_add("/time", msg);
   }
+  if((duration > 0) && (dtime > duration))
+    return;
   double beat(timesig.beat(dtime));
   double beat_frac(frac(beat));
   if((beat == 0) || ((timesig.numerator == 0) && (beat_frac == 0))) {
     // new bar, optionally update time signature:
     if(process_timesig()) {
-      lo_send(lo_addr, "/timesig", "fii", dtime, timesig.numerator,
-              timesig.denominator);
+      msg = lo_message_new();
+      lo_message_add(msg, "fii", dtime, timesig.numerator, timesig.denominator);
+      bundle_add("/timesig", msg);
     }
   }
   beat = timesig.beat(dtime);
@@ -350,11 +387,18 @@ void composer_t::process_time()
     }
   }
   if(beat_frac == 0) {
-    lo_send(lo_addr, "/beat", "f", beat);
-    lo_send(lo_addr, "/beat", "fff", dtime, beat, (float)timesig.denominator);
+    msg = lo_message_new();
+    lo_message_add_float(msg, beat);
+    bundle_add("/beat", msg);
+    msg = lo_message_new();
+    lo_message_add(msg, "fff", dtime, beat, (float)timesig.denominator);
+    bundle_add("/beat", msg);
+  }
+  if(harmony.process(beat)) {
+    msg = lo_message_new();
+    lo_message_add(msg, "fii", dtime, get_key(), get_mode());
+    bundle_add("/key", msg);
   }
-  if(harmony.process(beat))
-    lo_send(lo_addr, "/key", "fii", dtime, get_key(), get_mode());
   for(unsigned int k = 0; k < voice.size(); k++) {
     if(voice[k].pbeat.size()) {
       if((voice[k].note.end_time() <= dtime) || first) {
@@ -362,13 +406,14 @@ void composer_t::process_time()
             beat, harmony, timesig, pcenter[k] + dpitch, pbandw[k],
             1.0 - pow(pitchchaos, 2.0), 1.0 - pow(beatchaos, 1.0), pmodf[k]);
         voice[k].note.time = dtime;
-        lo_send(lo_addr, "/note", "iiif", k, voice[k].note.pitch,
-                voice[k].note.length, voice[k].note.time);
+        msg = lo_message_new();
+        lo_message_add(msg, "iiif", k, voice[k].note.pitch,
+                       voice[k].note.length, voice[k].note.time);
+        bundle_add("/note", msg);
       }
     }
   }
   first = false;
-  ++time;
 }
 
 void composer_t::comp_thread()
@@ -25,20 +25,29 @@
 */
 
 #include "libhos_audiochunks.h"
+#include "libhos_ifanalysis.h"
+#include "libhos_workerpool.h"
+#include "triplebuffer.h"
+#include <atomic>
 #include <cairomm/context.h>
 #include <gtkmm.h>
 #include <gtkmm/drawingarea.h>
 #include <gtkmm/main.h>
 #include <gtkmm/window.h>
 #include <iostream>
+#include <jack/ringbuffer.h>
 #include <stdlib.h>
 #include <tascar/jackclient.h>
 #include <tascar/osc_helper.h>
 #include <tascar/stft.h>
+#include <thread>
+#include <unistd.h>
 
 #define OSC_ADDR "239.255.1.7"
 #define OSC_PORT "6978"
 #define HIST_SIZE 256
+// number of pitch class cells per octave:
+#define PC_RES 48
 
 namespace HoSGUI {
 
@@ -49,13 +58,15 @@ namespace HoSGUI {
     void set_values(const std::vector<double>& v);
     static int osc_setval(const char* path, const char* types, lo_arg** argv,
                           int argc, lo_message msg, void* user_data);
-    void draw(Cairo::RefPtr<Cairo::Context> cr, double phase);
+    void draw(Cairo::RefPtr<Cairo::Context> cr, double phase,
+              const double* hist);
     void calc_chroma(float* samples, uint32_t n);
     void update_history(double phase);
+    void get_history(double* hist) const;
     void set_f0(uint32_t ch, double f);
 
   private:
-    double mapped_intensity(double f, double t0, double i);
+    void update_pitchclass_map();
     double x_;
     double y_;
     uint32_t channels_;
@@ -66,16 +77,34 @@ namespace HoSGUI {
     std::vector<double> col_g;
     std::vector<double> col_b;
     TASCAR::wave_t inBuffer;
-    HoS::delay1_t delay;
     TASCAR::stft_t stft0;
-    TASCAR::stft_t stft1;
-    TASCAR::wave_t instf;
+    HoS::if_analysis_t ifa;
     std::vector<double> t0;
+    std::vector<float> log2f0;
+    /// Candidate channels for each pitch class cell:
+    std::vector<std::vector<uint32_t>> pc_channels;
     std::vector<double> chroma;
-    double ifscale;
     double last_phase;
   };
 
+  /**
+     \brief Display data of all cycles
+   */
+  class cycle_frame_t {
+  public:
+    double phase;
+    /// History of all cycles, indexed by cycle, time and channel:
+    std::vector<double> history;
+  };
+
+  /**
+     \brief Display of pitch intensities of several instruments
+
+     The JACK callback only passes the input signals via a lock-free
+     ring buffer to an analysis thread. The analysis of the cycles
+     (instruments) is distributed on a pool of worker threads, and
+     the resulting history is passed to the GUI via a triple buffer.
+   */
   class cyclephase_t : public Gtk::DrawingArea,
                        public TASCAR::osc_server_t,
                        public jackc_t {
@@ -90,6 +119,8 @@ namespace HoSGUI {
     void set_f0(uint32_t ch, double f);
 
   protected:
+    void analysis_thread();
+    static void calc_chroma_job(uint32_t k, void* data);
     // Override default signal handler:
     bool on_draw(const Cairo::RefPtr<Cairo::Context>& cr);
     // virtual bool on_expose_event(GdkEventExpose* event);
@@ -99,6 +130,15 @@ namespace HoSGUI {
     double phase;
     uint32_t channels_;
     std::string name_;
+    /// Size of one block in the ring buffer, in samples:
+    uint32_t record_size;
+    jack_ringbuffer_t* rb;
+    std::vector<float> record;
+    HoS::worker_pool_t* pool;
+    HoS::triple_buffer_t<cycle_frame_t>* frames;
+    std::thread worker;
+    std::atomic<bool> b_run_worker;
+    std::atomic<uint32_t> lost_blocks;
   };
 
 } // namespace HoSGUI
@@ -108,12 +148,12 @@ using namespace HoSGUI;
 cycle_t::cycle_t(double x, double y, uint32_t channels, const std::string& name,
                  uint32_t chunksize, double srate)
     : x_(x), y_(y), channels_(channels), name_(name), current(channels, 0.0),
-      inBuffer(chunksize), delay(chunksize),
+      inBuffer(chunksize),
       stft0(std::max(2048u, 2 * chunksize), std::max(2048u, 2 * chunksize),
             chunksize, TASCAR::stft_t::WND_HANNING, 0.5),
-      stft1(std::max(2048u, 2 * chunksize), std::max(2048u, 2 * chunksize),
-            chunksize, TASCAR::stft_t::WND_HANNING, 0.5),
-      instf(stft0.s.n_), ifscale(srate / (2.0 * M_PI)), last_phase(0.0)
+      ifa(std::max(2048u, 2 * chunksize), std::max(2048u, 2 * chunksize),
+          chunksize, srate, false),
+      last_phase(0.0)
 {
   history.resize(HIST_SIZE);
   for(unsigned int k = 0; k < history.size(); k++)
@@ -127,28 +167,54 @@ cycle_t::cycle_t(double x, double y, uint32_t channels, const std::string& name,
     col_b[k] = 0.5 + 0.5 * cos(k * M_PI * 2.0 / channels + 4.0 / 3.0 * M_PI);
   }
   t0.resize(channels);
+  log2f0.resize(channels);
   chroma.resize(channels);
+  pc_channels.resize(PC_RES);
 }
 
-double cycle_t::mapped_intensity(double f, double t0, double i)
+// pitch range of each channel is a quarter tone below and above f0
+// (log2(0.97153) and log2(1.02903)):
+#define PC_LOW -0.0416621f
+#define PC_HIGH 0.0412775f
+// do not check for more than 5 octaves above f0:
+#define PC_OCTAVES 5.0f
+
+/**
+   \brief Check if a frequency matches the pitch of a channel
+   \param d Logarithmic frequency relative to f0 of the channel, in octaves
+ */
+static inline bool pitch_match(float d)
 {
-  double ft;
-  // do not check for more than 5 octaves:
-  if(f * t0 > 32)
-    return 0.0;
-  // a quarter tone above f0:
-  while((ft = f * t0) > 1.02903)
-    f *= 0.5;
-  // a quarter tone below f0:
-  if(ft > 0.97153)
-    return i;
-  return 0.0;
+  float m(std::max(0.0f, ceilf(d - PC_HIGH)));
+  float r(d - m);
+  return (d <= PC_OCTAVES) && (r > PC_LOW) && (r <= PC_HIGH);
 }
 
 void cycle_t::set_f0(uint32_t ch, double f)
 {
-  if(f > 0)
+  if(f > 0) {
     t0[ch] = 1.0 / f;
+    log2f0[ch] = log2(f);
+    update_pitchclass_map();
+  }
+}
+
+/**
+   \brief Assign channels to the pitch class cells covered by their
+   pitch range
+ */
+void cycle_t::update_pitchclass_map()
+{
+  for(auto& cell : pc_channels)
+    cell.clear();
+  for(uint32_t ch = 0; ch < channels_; ch++) {
+    if(t0[ch] <= 0)
+      continue;
+    int32_t c0(floorf((log2f0[ch] + PC_LOW) * PC_RES));
+    int32_t c1(floorf((log2f0[ch] + PC_HIGH) * PC_RES));
+    for(int32_t c = c0; c <= c1; ++c)
+      pc_channels[((c % PC_RES) + PC_RES) % PC_RES].push_back(ch);
+  }
 }
 
 void cycle_t::update_history(double phase)
@@ -177,6 +243,13 @@ void cycle_t::update_history(double phase)
   last_phase = phase;
 }
 
+void cycle_t::get_history(double* hist) const
+{
+  for(unsigned int k = 0; k < history.size(); k++)
+    for(unsigned int ch = 0; ch < channels_; ch++)
+      *(hist++) = history[k][ch];
+}
+
 void cycle_t::set_values(const std::vector<double>& v)
 {
   if(v.size() == current.size())
@@ -201,21 +274,23 @@ void cycle_t::calc_chroma(float* samples, uint32_t n)
   for(uint32_t k = 0; k < std::min(n, inBuffer.n); k++) {
     inBuffer.d[k] = samples[k];
   }
-  delay.process(inBuffer);
   stft0.process(inBuffer);
-  stft1.process(delay);
-  for(unsigned int k = 0; k < stft0.s.n_; k++) {
-    stft0.s.b[k] *= conj(stft1.s.b[k]);
-    instf.d[k] = std::arg(stft0.s.b[k]) * ifscale;
-  }
+  ifa.process(inBuffer, stft0.s);
   double te(0.0);
   for(unsigned int ch = 0; ch < channels_; ch++)
     chroma[ch] = 0.0;
-  for(unsigned int k = 0; k < instf.n; k++) {
-    double le(std::abs(stft0.s.b[k]));
+  for(unsigned int k = 0; k < ifa.size(); k++) {
+    double le(ifa.mag[k]);
     te += le;
-    for(unsigned int ch = 0; ch < channels_; ch++)
-      chroma[ch] += mapped_intensity(instf.d[k], t0[ch], le);
+    float f(ifa.ifreq[k]);
+    if(f <= 0.0f)
+      continue;
+    // pitch class cell from fractional part of octave:
+    float l(HoS::fast_log2f(f));
+    uint32_t cell(std::min(PC_RES - 1, (int)((l - floorf(l)) * PC_RES)));
+    for(auto ch : pc_channels[cell])
+      if(pitch_match(l - log2f0[ch]))
+        chroma[ch] += le;
   }
   if(te > 0)
     te = 1.0 / te;
@@ -224,7 +299,14 @@ void cycle_t::calc_chroma(float* samples, uint32_t n)
   set_values(chroma);
 }
 
-void cycle_t::draw(Cairo::RefPtr<Cairo::Context> cr, double phase)
+/**
+   \brief Draw cycle
+   \param cr Cairo context
+   \param phase Cycle phase
+   \param hist History, as returned by get_history()
+ */
+void cycle_t::draw(Cairo::RefPtr<Cairo::Context> cr, double phase,
+                   const double* hist)
 {
   cr->save();
   cr->translate(-x_, -y_);
@@ -234,7 +316,7 @@ void cycle_t::draw(Cairo::RefPtr<Cairo::Context> cr, double phase)
     double r(0.4 + 0.6 * ch / channels_);
     cr->set_source_rgb(col_r[ch], col_g[ch], col_b[ch]);
     for(unsigned int kh = 0; kh < history.size(); kh++) {
-      cr->set_line_width(1.5 * history[kh][ch] / (2 * channels_));
+      cr->set_line_width(1.5 * hist[kh * channels_ + ch] / (2 * channels_));
       cr->arc(0, 0, r, ((double)kh - 1.0) * hscale - 0.5 * M_PI,
               kh * hscale - 0.5 * M_PI);
       cr->stroke();
@@ -256,14 +338,54 @@ void cycle_t::draw(Cairo::RefPtr<Cairo::Context> cr, double phase)
 int cyclephase_t::process(jack_nframes_t n, const std::vector<float*>& vIn,
                           const std::vector<float*>& vOut)
 {
-  phase = vIn[0][0];
-  for(unsigned int k = 0; k < vCycle.size(); k++) {
-    vCycle[k]->calc_chroma(vIn[k + 1], n);
-    vCycle[k]->update_history(phase);
+  if(!rb || (n != fragsize))
+    return 0;
+  if(jack_ringbuffer_write_space(rb) < record_size * sizeof(float)) {
+    ++lost_blocks;
+    return 0;
   }
+  // only the first sample of the phase signal is used:
+  jack_ringbuffer_write(rb, (const char*)(vIn[0]), sizeof(float));
+  for(unsigned int k = 0; k < vCycle.size(); k++)
+    jack_ringbuffer_write(rb, (const char*)(vIn[k + 1]), n * sizeof(float));
   return 0;
 }
 
+void cyclephase_t::calc_chroma_job(uint32_t k, void* data)
+{
+  cyclephase_t* self((cyclephase_t*)data);
+  self->vCycle[k]->calc_chroma(&(self->record[1 + k * self->fragsize]),
+                               self->fragsize);
+}
+
+void cyclephase_t::analysis_thread()
+{
+  const size_t bytes(record_size * sizeof(float));
+  while(b_run_worker) {
+    bool b_new(false);
+    while(jack_ringbuffer_read_space(rb) >= bytes) {
+      jack_ringbuffer_read(rb, (char*)(record.data()), bytes);
+      phase = record[0];
+      pool->run(vCycle.size(), &cyclephase_t::calc_chroma_job, this);
+      for(auto cycle : vCycle)
+        cycle->update_history(phase);
+      b_new = true;
+    }
+    if(b_new) {
+      cycle_frame_t& frame(frames->write_buffer());
+      frame.phase = phase;
+      for(unsigned int k = 0; k < vCycle.size(); k++)
+        vCycle[k]->get_history(&(frame.history[k * HIST_SIZE * channels_]));
+      frames->publish();
+    }
+    uint32_t lost(lost_blocks.exchange(0));
+    if(lost)
+      std::cerr << "Warning: Analysis is too slow, lost " << lost
+                << " blocks." << std::endl;
+    usleep(1000);
+  }
+}
+
 void cyclephase_t::set_f0(uint32_t ch, double f)
 {
   for(unsigned int k = 0; k < vCycle.size(); k++)
@@ -272,7 +394,8 @@ void cyclephase_t::set_f0(uint32_t ch, double f)
 
 cyclephase_t::cyclephase_t(const std::string& name, uint32_t channels)
     : osc_server_t(OSC_ADDR, OSC_PORT, "UDP"), jackc_t("cyclephase"), phase(0),
-      channels_(channels), name_(name)
+      channels_(channels), name_(name), record_size(1), rb(NULL), pool(NULL),
+      frames(NULL), b_run_worker(false), lost_blocks(0)
 {
   set_prefix("/" + name);
   Glib::signal_timeout().connect(
@@ -287,6 +410,20 @@ cyclephase_t::cyclephase_t(const std::string& name, uint32_t channels)
 
 void cyclephase_t::activate()
 {
+  // allocate buffers, now that the number of cycles is known:
+  record_size = 1 + vCycle.size() * fragsize;
+  record.resize(record_size);
+  // buffer of up to one second:
+  rb = jack_ringbuffer_create(sizeof(float) * record_size *
+                              std::max(4u, (uint32_t)(srate / fragsize)));
+  pool = new HoS::worker_pool_t(
+      std::min((uint32_t)vCycle.size(), std::thread::hardware_concurrency()));
+  cycle_frame_t frame;
+  frame.phase = 0;
+  frame.history.resize(vCycle.size() * HIST_SIZE * channels_, 0.0);
+  frames = new HoS::triple_buffer_t<cycle_frame_t>(frame);
+  b_run_worker = true;
+  worker = std::thread(&cyclephase_t::analysis_thread, this);
   jackc_t::activate();
   osc_server_t::activate();
   try {
@@ -301,10 +438,21 @@ void cyclephase_t::deactivate()
 {
   osc_server_t::deactivate();
   jackc_t::deactivate();
+  b_run_worker = false;
+  if(worker.joinable())
+    worker.join();
 }
 
 cyclephase_t::~cyclephase_t()
 {
+  if(worker.joinable()) {
+    b_run_worker = false;
+    worker.join();
+  }
+  delete pool;
+  delete frames;
+  if(rb)
+    jack_ringbuffer_free(rb);
   for(unsigned int k = 0; k < vCycle.size(); k++)
     delete vCycle[k];
 }
@@ -338,8 +486,12 @@ bool cyclephase_t::on_draw(const Cairo::RefPtr<Cairo::Context>& cr)
     cr->paint();
     cr->restore();
     // end bg
-    for(unsigned int k = 0; k < vCycle.size(); k++)
-      vCycle[k]->draw(cr, phase);
+    if(frames) {
+      const cycle_frame_t& frame(frames->read());
+      for(unsigned int k = 0; k < vCycle.size(); k++)
+        vCycle[k]->draw(cr, frame.phase,
+                        &(frame.history[k * HIST_SIZE * channels_]));
+    }
   }
   return true;
 }
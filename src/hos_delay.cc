@@ -25,9 +25,13 @@
 
 */
 
+#include "rampedvalue.h"
+#include <getopt.h>
 #include <iostream>
+#include <math.h>
 #include <stdlib.h>
 #include <string.h>
+#include <tascar/errorhandling.h>
 #include <tascar/jackclient.h>
 #include <tascar/osc_helper.h>
 #include <unistd.h>
@@ -38,129 +42,186 @@
 
 namespace HoS {
 
-  class rvalue_t {
+  /**
+     \brief Fractional delay interpolation method
+  */
+  enum interp_t { INTERP_LINEAR, INTERP_CUBIC, INTERP_ALLPASS };
+
+  /**
+     \ingroup apphos
+     \brief One delay tap, applied to all channels
+  */
+  class tap_t {
   public:
-    rvalue_t();
-    void copy(rvalue_t& src);
-    void set(double v, double t);
-    inline void step()
+    tap_t(double srate, double gain);
+    void set_delay(double delay, double ttime);
+    /// Take over new OSC values (audio thread):
+    void update()
     {
-      if(time > 0) {
-        current += (val - current) / time;
-        time -= 1.0;
-      } else {
-        current = val;
-      }
+      delay.update();
+      gain.update();
     };
-    double val;
-    double time;
-    bool applied;
-    double current;
+    static int osc_set_delay(const char* path, const char* types, lo_arg** argv,
+                             int argc, lo_message msg, void* user_data);
+    /// Delay in samples:
+    ramped_value_t<double> delay;
+    ramped_value_t<double> gain;
+
+  private:
+    double srate;
   };
 
   /**
      \ingroup apphos
+     \brief Multichannel multi-tap delay with fractional delays
+
+     The input of each channel is written to a ring buffer with a
+     power-of-two size. Each tap reads from all channels with its own
+     time-varying delay and gain. Taps which do not change within a
+     block are processed block-wise with linear or cubic
+     interpolation.
   */
   class delay_t : public jackc_t, public TASCAR::osc_server_t {
   public:
-    delay_t(const std::string& name);
+    delay_t(const std::string& name, uint32_t channels, uint32_t ntaps,
+            interp_t interp);
     ~delay_t();
-    void set_delay(double delay, double ttime);
-    void set_gain(double g, double t);
     void run();
     void quit() { b_quit = true; };
-    static int osc_set_gain(const char* path, const char* types, lo_arg** argv,
-                            int argc, lo_message msg, void* user_data);
-    static int osc_set_delay(const char* path, const char* types, lo_arg** argv,
-                             int argc, lo_message msg, void* user_data);
     static int osc_quit(const char* path, const char* types, lo_arg** argv,
                         int argc, lo_message msg, void* user_data);
 
   private:
     int process(jack_nframes_t nframes, const std::vector<float*>& inBuffer,
                 const std::vector<float*>& outBuffer);
-    double dt;
-    float delayline[MAXDELAY];
-    rvalue_t osc_delay;
-    rvalue_t delay;
-    rvalue_t osc_gain;
-    rvalue_t gain;
-    // double target_delay;
-    // double target_time;
-    // double osc_delay;
-    // double osc_targettime;
-    // double current_delay;
+    bool process_static(tap_t& tap, uint32_t n,
+                        const std::vector<float*>& outBuffer);
+    void process_ramp(tap_t& tap, float* ap_state, uint32_t n,
+                      const std::vector<float*>& outBuffer);
+    uint32_t nchannels;
+    interp_t interp;
+    // minimum delay in samples for the interpolation method:
+    double mindelay;
+    uint32_t size;
+    uint32_t mask;
+    // ring buffers of all channels:
+    std::vector<float> ring;
+    std::vector<tap_t*> taps;
+    // state of allpass interpolators, for each tap and channel:
+    std::vector<float> ap_state;
+    // position of the next input sample:
     uint32_t in_pos;
-    uint32_t out_pos;
     bool b_quit;
-    pthread_mutex_t mutex;
   };
 
 } // namespace HoS
 
 using namespace HoS;
 
-rvalue_t::rvalue_t() : val(0), time(0), applied(false), current(0) {}
-
-void rvalue_t::copy(rvalue_t& src)
+/**
+   \brief Linear interpolation between x[p] and x[p-1]
+*/
+static inline float interp_linear(const float* x, uint32_t mask, uint32_t p,
+                                  float f)
 {
-  val = src.val;
-  time = src.time;
-  src.applied = true;
+  const float x0(x[p]);
+  return x0 + f * (x[(p - 1) & mask] - x0);
 }
 
-void rvalue_t::set(double v, double t)
+/**
+   \brief Cubic (Catmull-Rom) interpolation between x[p] and x[p-1]
+*/
+static inline float interp_cubic(const float* x, uint32_t mask, uint32_t p,
+                                 float f)
 {
-  val = v;
-  time = t;
-  applied = false;
+  const float xm1(x[(p + 1) & mask]);
+  const float x0(x[p]);
+  const float x1(x[(p - 1) & mask]);
+  const float x2(x[(p - 2) & mask]);
+  return x0 + 0.5f * f *
+                  (x1 - xm1 +
+                   f * (2.0f * xm1 - 5.0f * x0 + 4.0f * x1 - x2 +
+                        f * (3.0f * (x0 - x1) + x2 - xm1)));
 }
 
-delay_t::delay_t(const std::string& name)
-    : jackc_t(name), TASCAR::osc_server_t(OSC_ADDR, OSC_PORT, "UDP"),
-      dt(1.0 / srate),
-      // target_delay(0.0),
-      // target_time(0.0),
-      // osc_delay(0.0),
-      // osc_targettime(0.0),
-      // current_delay(0.0),
-      in_pos(0), out_pos(0), b_quit(false)
+tap_t::tap_t(double srate_, double g)
+    : delay(0.0, srate_), gain(g, srate_), srate(srate_)
 {
-  osc_gain.val = 1.0;
-  osc_gain.time = 1.0;
-  pthread_mutex_init(&mutex, NULL);
-  memset(delayline, 0, sizeof(float) * MAXDELAY);
-  add_input_port("in");
-  add_output_port("out");
-  set_prefix("/" + name);
-  add_method("/delay", "ff", delay_t::osc_set_delay, this);
-  add_method("/gain", "ff", delay_t::osc_set_gain, this);
-  add_method("/quit", "", delay_t::osc_quit, this);
 }
 
-delay_t::~delay_t()
+void tap_t::set_delay(double d, double ttime)
 {
-  pthread_mutex_trylock(&mutex);
-  pthread_mutex_unlock(&mutex);
-  pthread_mutex_destroy(&mutex);
+  delay.set(d * srate, ttime);
 }
 
-int delay_t::osc_set_delay(const char* path, const char* types, lo_arg** argv,
-                           int argc, lo_message msg, void* user_data)
+int tap_t::osc_set_delay(const char* path, const char* types, lo_arg** argv,
+                         int argc, lo_message msg, void* user_data)
 {
   if((user_data) && (argc == 2) && (types[0] == 'f') && (types[1] == 'f')) {
-    ((delay_t*)user_data)->set_delay(argv[0]->f, argv[1]->f);
+    ((tap_t*)user_data)->set_delay(argv[0]->f, argv[1]->f);
   }
   return 0;
 }
 
-int delay_t::osc_set_gain(const char* path, const char* types, lo_arg** argv,
-                          int argc, lo_message msg, void* user_data)
+delay_t::delay_t(const std::string& name, uint32_t channels, uint32_t ntaps,
+                 interp_t interp_)
+    : jackc_t(name), TASCAR::osc_server_t(OSC_ADDR, OSC_PORT, "UDP"),
+      nchannels(channels), interp(interp_), mindelay(0.0), size(1),
+      in_pos(0), b_quit(false)
 {
-  if((user_data) && (argc == 2) && (types[0] == 'f') && (types[1] == 'f')) {
-    ((delay_t*)user_data)->set_gain(argv[0]->f, argv[1]->f);
+  if(nchannels == 0)
+    throw TASCAR::ErrMsg("At least one channel is required.");
+  if(ntaps == 0)
+    throw TASCAR::ErrMsg("At least one tap is required.");
+  switch(interp) {
+  case INTERP_LINEAR:
+    mindelay = 0.0;
+    break;
+  case INTERP_CUBIC:
+    // the interpolator needs one sample after the read position:
+    mindelay = 1.0;
+    break;
+  case INTERP_ALLPASS:
+    // fractional part of the allpass is kept between 0.5 and 1.5:
+    mindelay = 0.5;
+    break;
   }
-  return 0;
+  // the whole block is written before reading, and the cubic
+  // interpolator needs two more samples:
+  while(size < MAXDELAY + fragsize + 3)
+    size <<= 1;
+  mask = size - 1;
+  ring.resize(size * nchannels, 0.0f);
+  ap_state.resize(ntaps * nchannels, 0.0f);
+  // only the first tap is audible by default:
+  for(uint32_t k = 0; k < ntaps; ++k)
+    taps.push_back(new tap_t(srate, (k == 0) ? 1.0 : 0.0));
+  if(nchannels == 1) {
+    add_input_port("in");
+    add_output_port("out");
+  } else {
+    for(uint32_t k = 0; k < nchannels; ++k) {
+      std::string num(std::to_string(k + 1));
+      add_input_port("in." + num);
+      add_output_port("out." + num);
+    }
+  }
+  set_prefix("/" + name);
+  add_method("/delay", "ff", tap_t::osc_set_delay, taps[0]);
+  add_method("/gain", "ff", osc_set_ramp<double>, &(taps[0]->gain));
+  for(uint32_t k = 0; k < ntaps; ++k) {
+    std::string num(std::to_string(k + 1));
+    add_method("/" + num + "/delay", "ff", tap_t::osc_set_delay, taps[k]);
+    add_method("/" + num + "/gain", "ff", osc_set_ramp<double>,
+               &(taps[k]->gain));
+  }
+  add_method("/quit", "", delay_t::osc_quit, this);
+}
+
+delay_t::~delay_t()
+{
+  for(auto tap : taps)
+    delete tap;
 }
 
 int delay_t::osc_quit(const char* path, const char* types, lo_arg** argv,
@@ -171,48 +232,111 @@ int delay_t::osc_quit(const char* path, const char* types, lo_arg** argv,
   return 0;
 }
 
-void delay_t::set_delay(double delay, double ttime)
+/**
+   \brief Process a tap with constant delay and gain
+
+   The read position is contiguous within the block unless it wraps
+   around, so the loops are vectorised.
+
+   \return False if the read position wraps around within the block,
+   nothing is processed in that case.
+*/
+bool delay_t::process_static(tap_t& tap, uint32_t n,
+                             const std::vector<float*>& outBuffer)
 {
-  pthread_mutex_lock(&mutex);
-  osc_delay.set(delay * srate, ttime * srate);
-  pthread_mutex_unlock(&mutex);
+  const double d(
+      std::min(std::max(tap.delay.current(), mindelay), MAXDELAY - 1.0));
+  const uint32_t di(d);
+  // position of first output sample, delayed by integer part:
+  const uint32_t p0((in_pos - di) & mask);
+  // read positions including interpolator support:
+  if((p0 < 2) || (p0 + n + 1 > size))
+    return false;
+  const float f(d - di);
+  const float g(tap.gain.current());
+  for(uint32_t ch = 0; ch < nchannels; ++ch) {
+    // x[n+1], x[n], x[n-1] and x[n-2], relative to the read position:
+    const float* xm1(&(ring[ch * size + p0 + 1]));
+    const float* x0(&(ring[ch * size + p0]));
+    const float* x1(&(ring[ch * size + p0 - 1]));
+    const float* x2(&(ring[ch * size + p0 - 2]));
+    float* o(outBuffer[ch]);
+    if(interp == INTERP_LINEAR) {
+      for(uint32_t i = 0; i < n; ++i)
+        o[i] += g * (x0[i] + f * (x1[i] - x0[i]));
+    } else {
+      const float c0(0.5f * f);
+      for(uint32_t i = 0; i < n; ++i) {
+        const float a3(3.0f * (x0[i] - x1[i]) + x2[i] - xm1[i]);
+        const float a2(2.0f * xm1[i] - 5.0f * x0[i] + 4.0f * x1[i] - x2[i]);
+        o[i] += g * (x0[i] + c0 * (x1[i] - xm1[i] + f * (a2 + f * a3)));
+      }
+    }
+  }
+  return true;
 }
 
-void delay_t::set_gain(double g, double t)
+/**
+   \brief Process a tap sample by sample, with time-varying delay and
+   gain
+*/
+void delay_t::process_ramp(tap_t& tap, float* ap, uint32_t n,
+                           const std::vector<float*>& outBuffer)
 {
-  pthread_mutex_lock(&mutex);
-  osc_gain.set(g, t * srate);
-  pthread_mutex_unlock(&mutex);
+  for(uint32_t i = 0; i < n; ++i) {
+    const float g(tap.gain.step());
+    const double d(
+        std::min(std::max(tap.delay.step(), mindelay), MAXDELAY - 1.0));
+    if(interp == INTERP_ALLPASS) {
+      // first order Thiran allpass, fractional part in [0.5,1.5[:
+      const uint32_t di(d - 0.5);
+      const float f(d - di);
+      const float eta((1.0f - f) / (1.0f + f));
+      const uint32_t p((in_pos + i - di) & mask);
+      for(uint32_t ch = 0; ch < nchannels; ++ch) {
+        const float* x(&(ring[ch * size]));
+        ap[ch] = eta * (x[p] - ap[ch]) + x[(p - 1) & mask];
+        outBuffer[ch][i] += g * ap[ch];
+      }
+    } else {
+      const uint32_t di(d);
+      const float f(d - di);
+      const uint32_t p((in_pos + i - di) & mask);
+      for(uint32_t ch = 0; ch < nchannels; ++ch) {
+        const float* x(&(ring[ch * size]));
+        if(interp == INTERP_LINEAR)
+          outBuffer[ch][i] += g * interp_linear(x, mask, p, f);
+        else
+          outBuffer[ch][i] += g * interp_cubic(x, mask, p, f);
+      }
+    }
+  }
 }
 
 int delay_t::process(jack_nframes_t nframes,
                      const std::vector<float*>& inBuffer,
                      const std::vector<float*>& outBuffer)
 {
-  // set_preset();
-  float* v_in(inBuffer[0]);
-  float* v_out(outBuffer[0]);
-  if(pthread_mutex_trylock(&mutex) == 0) {
-    if(!osc_delay.applied)
-      delay.copy(osc_delay);
-    if(!osc_gain.applied)
-      gain.copy(osc_gain);
-    pthread_mutex_unlock(&mutex);
+  for(auto tap : taps)
+    tap->update();
+  // write input block to ring buffers:
+  for(uint32_t ch = 0; ch < nchannels; ++ch) {
+    float* r(&(ring[ch * size]));
+    const float* v_in(inBuffer[ch]);
+    for(jack_nframes_t i = 0; i < nframes; ++i)
+      r[(in_pos + i) & mask] = v_in[i];
+    memset(outBuffer[ch], 0, nframes * sizeof(float));
   }
-  // main loop:
-  for(jack_nframes_t i = 0; i < nframes; ++i) {
-    gain.step();
-    delay.step();
-    delay.current = std::min(std::max(delay.current, 0.0), MAXDELAY - 1.0);
-    out_pos = in_pos + delay.current;
-    while(out_pos >= MAXDELAY)
-      out_pos -= MAXDELAY;
-    delayline[in_pos] = v_in[i];
-    v_out[i] = gain.current * delayline[out_pos];
-    if(!in_pos)
-      in_pos = MAXDELAY;
-    in_pos--;
+  for(uint32_t k = 0; k < taps.size(); ++k) {
+    tap_t& tap(*(taps[k]));
+    // allpass interpolation is recursive, and is always processed
+    // sample by sample:
+    if(!(tap.delay.ramping() || tap.gain.ramping()) &&
+       (interp != INTERP_ALLPASS) && process_static(tap, nframes, outBuffer))
+      continue;
+    process_ramp(tap, &(ap_state[k * nchannels]), nframes, outBuffer);
   }
+  in_pos = (in_pos + nframes) & mask;
   return 0;
 }
 
@@ -227,12 +351,59 @@ void delay_t::run()
   TASCAR::osc_server_t::deactivate();
 }
 
+void usage(struct option* opt)
+{
+  std::cout << "Usage:\n\nhos_delay [options] [name]\n\nOptions:\n\n";
+  while(opt->name) {
+    std::cout << "  -" << (char)(opt->val) << " " << (opt->has_arg ? "#" : "")
+              << "\n  --" << opt->name << (opt->has_arg ? "=#" : "") << "\n\n";
+    opt++;
+  }
+  std::cout << "Interpolation methods: linear, cubic, allpass\n";
+}
+
 int main(int argc, char** argv)
 {
   std::string name("delay");
-  if(argc > 1)
-    name = argv[1];
-  delay_t S(name);
+  uint32_t channels(1);
+  uint32_t ntaps(1);
+  interp_t interp(INTERP_LINEAR);
+  const char* options = "hc:t:i:";
+  struct option long_options[] = {{"help", 0, 0, 'h'},
+                                  {"channels", 1, 0, 'c'},
+                                  {"taps", 1, 0, 't'},
+                                  {"interp", 1, 0, 'i'},
+                                  {0, 0, 0, 0}};
+  int opt(0);
+  int option_index(0);
+  while((opt = getopt_long(argc, argv, options, long_options, &option_index)) !=
+        -1) {
+    switch(opt) {
+    case 'h':
+      usage(long_options);
+      return -1;
+    case 'c':
+      channels = atoi(optarg);
+      break;
+    case 't':
+      ntaps = atoi(optarg);
+      break;
+    case 'i':
+      if(strcmp(optarg, "linear") == 0)
+        interp = INTERP_LINEAR;
+      else if(strcmp(optarg, "cubic") == 0)
+        interp = INTERP_CUBIC;
+      else if(strcmp(optarg, "allpass") == 0)
+        interp = INTERP_ALLPASS;
+      else
+        throw TASCAR::ErrMsg("Invalid interpolation method: " +
+                             std::string(optarg));
+      break;
+    }
+  }
+  if(optind < argc)
+    name = argv[optind];
+  delay_t S(name, channels, ntaps, interp);
   S.run();
 }
 
@@ -44,8 +44,10 @@
 
 */
 
+#include "fastmath.h"
 #include "filter.h"
 #include "hos_defs.h"
+#include "libhos_filterbank.h"
 #include "lininterp.h"
 #include <cairomm/context.h>
 #include <getopt.h>
@@ -94,6 +96,7 @@ public:
   std::vector<float> fc; ///< center frequencies
   std::vector<float> fe; ///< edge frequencies
   float band(float f_hz);
+  float band_index(float f_hz);
 
 private:
   float bpo_;
@@ -470,6 +473,7 @@ public:
   az_hist_t(uint32_t size);
   void update();
   bool add(float f, float az, float weight);
+  void add_az(float az, float weight);
   void set_tau(float tau, float fs);
   void set_frange(float f1, float f2);
 
@@ -500,15 +504,23 @@ void az_hist_t::update()
 bool az_hist_t::add(float f, float az, float weight)
 {
   if((f >= fmin) && (f < fmax)) {
-    az += M_PI;
-    az *= (0.5 * size() / M_PI);
-    uint32_t iaz(std::max(0.0f, std::min((float)(size() - 1), az)));
-    operator[](iaz) += c2 * weight;
+    add_az(az, weight);
     return true;
   }
   return false;
 }
 
+/**
+   \brief Add intensity at the specified azimuth, independent of frequency
+ */
+void az_hist_t::add_az(float az, float weight)
+{
+  az += M_PI;
+  az *= (0.5 * size() / M_PI);
+  uint32_t iaz(std::max(0.0f, std::min((float)(size() - 1), az)));
+  operator[](iaz) += c2 * weight;
+}
+
 void az_hist_t::set_tau(float tau, float fs)
 {
   c1 = exp(-1.0 / (tau * fs));
@@ -537,6 +549,18 @@ float freqinfo_t::band(float f_hz)
   return bpo_ * log2(std::max(40.0f, f_hz) / fmin_);
 }
 
+/**
+   \brief Fractional index of a frequency on the axis of the center
+   frequencies
+ */
+float freqinfo_t::band_index(float f_hz)
+{
+  if(bands < 2)
+    return 0.0f;
+  return (bands - 1) * log2(std::max(40.0f, f_hz) / fc[0]) /
+         log2(fc[bands - 1] / fc[0]);
+}
+
 namespace HoSGUI {
 
   class foacoh_t : public freqinfo_t,
@@ -547,7 +571,8 @@ namespace HoSGUI {
     foacoh_t(const std::string& name, uint32_t channels, float bpo, float fmin,
              float fmax, const std::vector<std::string>& objnames,
              uint32_t periodsize, const std::string& url, uint32_t sortmode,
-             float levelthreshold_, float lpperiods, float taumax);
+             float levelthreshold_, float lpperiods, float taumax,
+             HoS::bandmode_t bandmode);
     virtual ~foacoh_t();
     virtual int inner_process(jack_nframes_t, const std::vector<float*>&,
                               const std::vector<float*>&);
@@ -558,6 +583,10 @@ namespace HoSGUI {
     // Override default signal handler:
     virtual bool on_draw(const Cairo::RefPtr<Cairo::Context>& cr);
     bool on_timeout();
+    void analyse_bins();
+    void analyse_bands(uint32_t n, const TASCAR::wave_t& inW,
+                       const TASCAR::wave_t& inX, const TASCAR::wave_t& inY);
+    HoS::bandmode_t bandmode;
     uint32_t periodsize;
     uint32_t fftlen;
     uint32_t wndlen;
@@ -595,14 +624,24 @@ namespace HoSGUI {
     HoS::arflt levellp;
     float level;
     float levelthreshold;
+    // constant-Q kernel, in BANDS_CONSTQ mode:
+    HoS::constq_t* cq;
+    // intensity weights of FFT bins, in BANDS_CONSTQ mode:
+    TASCAR::wave_t wbin;
+    // gammatone filterbanks of W, X and Y, in BANDS_GAMMATONE mode:
+    std::vector<HoS::gammatone_bank_t*> gt;
+    std::vector<float> gtbuf;
+    std::vector<std::vector<float*>> gt_re;
+    std::vector<std::vector<float*>> gt_im;
+    TASCAR::spec_t ccoh_band; ///< complex temporary coherence of bands
+    float band_c1;
+    float band_c2;
   };
 
 } // namespace HoSGUI
 
 using namespace HoSGUI;
 
-std::complex<float> If = 1i;
-
 int foacoh_t::inner_process(jack_nframes_t n, const std::vector<float*>& vIn,
                             const std::vector<float*>& vOut)
 {
@@ -620,31 +659,10 @@ int foacoh_t::inner_process(jack_nframes_t n, const std::vector<float*>& vIn,
   for(uint32_t kH = 0; kH < haz.size(); kH++)
     haz[kH].update();
   // do scene analysis:
-  for(uint32_t k = 0; k < ola_x.s.size(); k++) {
-    float freq(k * fscale);
-    // for all measures, X*conj(Y) and its absolute value is needed:
-    std::complex<float> cW(ola_w.s[k]);
-    std::complex<float> cX(ola_x.s[k]);
-    std::complex<float> cY(ola_y.s[k]);
-    std::complex<float> cXY(cX * std::conj(cY));
-    float cXYabs(std::abs(cXY));
-    // Measure 1: x-y-coherence:
-    ccohXY[k] *= lp_c1[k];
-    if(cXYabs > 0) {
-      ccohXY[k] += (lp_c2[k] / cXYabs) * cXY;
-    }
-    cohXY[k] = std::abs(ccohXY[k]);
-    if(std::abs(cW) > 0) {
-      cX /= cW;
-      cY /= cW;
-    }
-    az[k] = std::arg(cX + If * cY);
-    float w(powf(std::abs(cW) * cohXY[k], 2.0));
-    float l_az(az[k] + M_PI);
-    l_az *= (0.5 * haz.size() / M_PI);
-    for(uint32_t kH = 0; kH < haz.size(); kH++)
-      haz[kH].add(freq, az[k], w);
-  }
+  if(bandmode == HoS::BANDS_GAMMATONE)
+    analyse_bands(n, inW, inX, inY);
+  else
+    analyse_bins();
   // send model parameters:
   if(send_cnt == 0) {
     obj.send_osc(lo_addr);
@@ -681,16 +699,108 @@ int foacoh_t::inner_process(jack_nframes_t n, const std::vector<float*>& vIn,
   return 0;
 }
 
+/**
+   \brief Azimuth and intensity of FFT bins, accumulated in the
+   azimuth histograms of the bands
+ */
+void foacoh_t::analyse_bins()
+{
+  for(uint32_t k = 0; k < ola_x.s.size(); k++) {
+    float freq(k * fscale);
+    // for all measures, X*conj(Y) and its absolute value is needed:
+    std::complex<float> cW(ola_w.s[k]);
+    std::complex<float> cX(ola_x.s[k]);
+    std::complex<float> cY(ola_y.s[k]);
+    std::complex<float> cXY(cX * std::conj(cY));
+    float cXYabs(std::abs(cXY));
+    // Measure 1: x-y-coherence:
+    ccohXY[k] *= lp_c1[k];
+    if(cXYabs > 0) {
+      ccohXY[k] += (lp_c2[k] / cXYabs) * cXY;
+    }
+    cohXY[k] = std::abs(ccohXY[k]);
+    // arg((X+iY)/W) = arg((X+iY)*conj(W)) for W != 0:
+    float wnorm(std::norm(cW));
+    std::complex<float> cXiY(cX.real() - cY.imag(), cX.imag() + cY.real());
+    if(wnorm > 0)
+      cXiY *= std::conj(cW);
+    az[k] = HoS::fast_arg(cXiY);
+    float w(wnorm * cohXY[k] * cohXY[k]);
+    if(bandmode == HoS::BANDS_FFT) {
+      for(uint32_t kH = 0; kH < haz.size(); kH++)
+        haz[kH].add(freq, az[k], w);
+    } else
+      wbin[k] = w;
+  }
+  if(bandmode == HoS::BANDS_CONSTQ) {
+    // distribute the intensity of each bin to the bands with the
+    // constant-Q kernel:
+    for(uint32_t kb = 0; kb < bands; kb++) {
+      const float* kern(cq->kernel(kb));
+      const uint32_t k1(std::min(cq->bin_end(kb), wbin.n));
+      for(uint32_t k = cq->bin_start(kb); k < k1; ++k) {
+        haz[kb].add_az(az[k], (*kern) * wbin[k]);
+        ++kern;
+      }
+    }
+  }
+}
+
+/**
+   \brief Azimuth and intensity of gammatone bands, accumulated in the
+   azimuth histograms
+
+   The same measures as for FFT bins are computed from the complex
+   band signals, with the cross products averaged across the block.
+ */
+void foacoh_t::analyse_bands(uint32_t n, const TASCAR::wave_t& inW,
+                             const TASCAR::wave_t& inX,
+                             const TASCAR::wave_t& inY)
+{
+  n = std::min(n, periodsize);
+  gt[0]->process(inW.d, n, gt_re[0].data(), gt_im[0].data());
+  gt[1]->process(inX.d, n, gt_re[1].data(), gt_im[1].data());
+  gt[2]->process(inY.d, n, gt_re[2].data(), gt_im[2].data());
+  for(uint32_t kb = 0; kb < bands; kb++) {
+    std::complex<float> sXY(0.0f);
+    std::complex<float> sXiYW(0.0f);
+    float sW(0.0f);
+    const float* wr(gt_re[0][kb]);
+    const float* wi(gt_im[0][kb]);
+    const float* xr(gt_re[1][kb]);
+    const float* xi(gt_im[1][kb]);
+    const float* yr(gt_re[2][kb]);
+    const float* yi(gt_im[2][kb]);
+    for(uint32_t t = 0; t < n; ++t) {
+      std::complex<float> cW(wr[t], wi[t]);
+      std::complex<float> cX(xr[t], xi[t]);
+      std::complex<float> cY(yr[t], yi[t]);
+      sXY += cX * std::conj(cY);
+      std::complex<float> cXiY(cX.real() - cY.imag(), cX.imag() + cY.real());
+      sXiYW += cXiY * std::conj(cW);
+      sW += std::norm(cW);
+    }
+    // x-y-coherence:
+    ccoh_band[kb] *= band_c1;
+    float sXYabs(std::abs(sXY));
+    if(sXYabs > 0)
+      ccoh_band[kb] += (band_c2 / sXYabs) * sXY;
+    float coh(std::abs(ccoh_band[kb]));
+    haz[kb].add_az(HoS::fast_arg(sXiYW), sW * coh * coh);
+  }
+}
+
 foacoh_t::foacoh_t(const std::string& name, uint32_t channels, float bpo,
                    float fmin, float fmax,
                    const std::vector<std::string>& objnames,
                    uint32_t periodsize_, const std::string& url,
                    uint32_t sortmode, float levelthreshold_, float lpperiods,
-                   float taumax)
+                   float taumax, HoS::bandmode_t bandmode_)
     : freqinfo_t(bpo, fmin, fmax),
       // osc_server_t(OSC_ADDR,OSC_PORT),
       jackc_db_t("foacoh", periodsize_), osc_server_t("", "9788", "UDP"),
-      periodsize(periodsize_), fftlen(std::max(512u, 4 * periodsize)),
+      bandmode(bandmode_), periodsize(periodsize_),
+      fftlen(std::max(512u, 4 * periodsize)),
       wndlen(std::max(256u, 2 * periodsize)),
       ola_w(fftlen, wndlen, periodsize, TASCAR::stft_t::WND_HANNING,
             TASCAR::stft_t::WND_HANNING, 0.5),
@@ -707,16 +817,44 @@ foacoh_t::foacoh_t(const std::string& name, uint32_t channels, float bpo,
       vmin(0), vmax(1), lo_addr(lo_address_new_from_url(url.c_str())),
       names(objnames), send_cnt(2),
       levellp(0.125, 0.125, get_srate() / (float)periodsize), level(-200),
-      levelthreshold(levelthreshold_)
+      levelthreshold(levelthreshold_), cq(NULL), wbin(ola_x.s.size()),
+      ccoh_band(bands), band_c1(0), band_c2(1)
 {
   lo_address_set_ttl(lo_addr, 1);
   image = Gdk::Pixbuf::create(Gdk::COLORSPACE_RGB, false, 8, channels, bands);
   add_input_port("in.0w");
   add_input_port("in.1x");
   add_input_port("in.1y");
-  for(uint32_t k = 0; k < ola_w.s.size(); k++)
-    f2band.push_back(band((float)k * fscale));
+  // position of the FFT bins on the band axis, for object
+  // decomposition:
+  for(uint32_t k = 0; k < ola_w.s.size(); k++) {
+    if(bandmode == HoS::BANDS_FFT)
+      f2band.push_back(band((float)k * fscale));
+    else
+      f2band.push_back(band_index((float)k * fscale));
+  }
   float frame_rate(get_srate() / (float)periodsize);
+  if(bandmode == HoS::BANDS_CONSTQ)
+    cq = new HoS::constq_t(fftlen, get_srate(), fc, bpo);
+  if(bandmode == HoS::BANDS_GAMMATONE) {
+    // bandwidth is the distance of the band edges:
+    std::vector<float> bw;
+    for(uint32_t kb = 0; kb < bands; kb++)
+      bw.push_back(fe[kb + 1] - fe[kb]);
+    gtbuf.resize(6 * bands * periodsize);
+    gt_re.resize(3);
+    gt_im.resize(3);
+    for(uint32_t ch = 0; ch < 3; ch++) {
+      gt.push_back(new HoS::gammatone_bank_t(fc, bw, get_srate()));
+      for(uint32_t kb = 0; kb < bands; kb++) {
+        gt_re[ch].push_back(&(gtbuf[(2 * ch * bands + kb) * periodsize]));
+        gt_im[ch].push_back(
+            &(gtbuf[((2 * ch + 1) * bands + kb) * periodsize]));
+      }
+    }
+    band_c1 = exp(-1.0 / (0.04 * frame_rate));
+    band_c2 = 1.0f - band_c1;
+  }
   for(uint32_t ko = 0; ko < objnames.size(); ko++) {
     add_output_port(names[ko].c_str());
     ola_obj.push_back(new TASCAR::ola_t(fftlen, wndlen, periodsize,
@@ -790,6 +928,10 @@ foacoh_t::~foacoh_t()
   image.clear();
   for(uint32_t k = 0; k < ola_obj.size(); k++)
     delete ola_obj[k];
+  for(auto bank : gt)
+    delete bank;
+  if(cq)
+    delete cq;
 }
 
 void draw_ellipse(const Cairo::RefPtr<Cairo::Context>& cr, float x, float y,
@@ -904,8 +1046,9 @@ int main(int argc, char** argv)
   float taumax(1.0);
   uint32_t periodsize(1024);
   uint32_t sortmode(0);
+  HoS::bandmode_t bandmode(HoS::BANDS_FFT);
   std::vector<std::string> objnames;
-  const char* options = "hj:c:b:l:u:p:d:s:t:f:x:";
+  const char* options = "hj:c:b:l:u:p:d:s:t:f:x:a:";
   struct option long_options[] = {{"help", 0, 0, 'h'},
                                   {"jackname", 1, 0, 'j'},
                                   {"desturl", 1, 0, 'd'},
@@ -918,6 +1061,7 @@ int main(int argc, char** argv)
                                   {"threshold", 1, 0, 't'},
                                   {"lpperiods", 1, 0, 'f'},
                                   {"taumax", 1, 0, 'x'},
+                                  {"bands", 1, 0, 'a'},
                                   {0, 0, 0, 0}};
   int opt(0);
   int option_index(0);
@@ -960,6 +1104,9 @@ int main(int argc, char** argv)
     case 's':
       sortmode = atoi(optarg);
       break;
+    case 'a':
+      bandmode = HoS::parse_bandmode(optarg);
+      break;
     }
   }
   while(optind < argc)
@@ -974,7 +1121,7 @@ int main(int argc, char** argv)
   win.set_title(jackname);
   HoSGUI::foacoh_t c(jackname, channels, bpoctave, fmin, fmax, objnames,
                      periodsize, desturl, sortmode, levelthreshold, lpperiods,
-                     taumax);
+                     taumax, bandmode);
   win.add(c);
   win.set_default_size(640, 480);
   win.show_all();
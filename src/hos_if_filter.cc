@@ -27,10 +27,13 @@
 #include "filter.h"
 #include "hos_defs.h"
 #include "libhos_audiochunks.h"
+#include "libhos_ifanalysis.h"
+#include "libhos_workerpool.h"
 #include <getopt.h>
 #include <iostream>
 #include <signal.h>
 #include <stdlib.h>
+#include <tascar/errorhandling.h>
 #include <tascar/jackclient.h>
 #include <tascar/ola.h>
 #include <tascar/osc_helper.h>
@@ -38,56 +41,172 @@
 
 static bool b_quit(false);
 
+/**
+   \brief Filter state and parameters of one channel
+ */
+class if_channel_t {
+public:
+  if_channel_t(uint32_t fragsize, double srate);
+  void process(const TASCAR::wave_t& w_in, TASCAR::wave_t& w_out,
+               float tau_gain, float extgain);
+  float sigma0;
+  float tau_std;
+  bool b_invert;
+
+private:
+  TASCAR::ola_t ola;
+  HoS::if_analysis_t ifa;
+  HoS::filter_array_t pow_lp;
+};
+
+if_channel_t::if_channel_t(uint32_t fragsize, double srate)
+    : sigma0(30.0), tau_std(0.05), b_invert(false),
+      ola(4 * fragsize, 2 * fragsize, fragsize, TASCAR::stft_t::WND_HANNING,
+          TASCAR::stft_t::WND_HANNING, 0.5),
+      ifa(4 * fragsize, 2 * fragsize, fragsize, srate),
+      pow_lp(2, srate / (double)fragsize)
+{
+}
+
+void if_channel_t::process(const TASCAR::wave_t& w_in, TASCAR::wave_t& w_out,
+                           float tau_gain, float extgain)
+{
+  float sigma0_corr(0.69315f / sigma0);
+  ifa.set_tau(tau_std);
+  pow_lp.set_lowpass(tau_gain);
+  ola.process(w_in);
+  ifa.process(w_in, ola.s);
+  double pow_in(1e-20);
+  double pow_out(1e-20);
+  for(unsigned int k = 0; k < ifa.size(); k++) {
+    float gain = 1.0f - HoS::fast_expf(-ifa.ifstd[k] * sigma0_corr);
+    if(gain < 1e-4)
+      gain = 1e-4;
+    if(b_invert)
+      gain = 1.0 - gain;
+    pow_in += std::norm(ola.s[k]);
+    ola.s[k] *= gain;
+    pow_out += std::norm(ola.s[k]);
+  }
+  float bbgain(sqrtf(pow_lp.filter(0, pow_in) / pow_lp.filter(1, pow_out)));
+  ola.s *= (bbgain * extgain);
+  ola.ifft(w_out);
+}
+
+/**
+   \brief Instantaneous frequency filter for one or more channels
+
+   All channels share the same analysis configuration. If more than
+   one channel is used, the channels are processed in parallel on a
+   pool of worker threads. The parameters sigma, tau and invert can
+   be set for all channels at once (e.g., /iff/sigma) or for
+   individual channels (e.g., /iff/2/sigma).
+ */
 class if_filter_t : public jackc_db_t, public TASCAR::osc_server_t {
 public:
   if_filter_t(const std::string& server_addr, const std::string& server_port,
-              const std::string& jackname, uint32_t fragsize);
+              const std::string& jackname, uint32_t fragsize,
+              uint32_t channels, uint32_t nthreads);
+  ~if_filter_t();
   int inner_process(jack_nframes_t n, const std::vector<float*>& inBuf,
                     const std::vector<float*>& outBuf);
   void activate();
   void deactivate();
+  static int osc_set_sigma(const char* path, const char* types, lo_arg** argv,
+                           int argc, lo_message msg, void* user_data);
+  static int osc_set_tau(const char* path, const char* types, lo_arg** argv,
+                         int argc, lo_message msg, void* user_data);
+  static int osc_set_invert(const char* path, const char* types,
+                            lo_arg** argv, int argc, lo_message msg,
+                            void* user_data);
 
 private:
-  TASCAR::ola_t ola;
-  TASCAR::stft_t dtfft;
-  HoS::delay1_t d1;
-  float ifscale;
-  HoS::filter_array_t mean_lp;
-  HoS::filter_array_t std_lp;
-  HoS::filter_array_t pow_lp;
-  float sigma0;
-  float tau_std;
+  static void process_channel(uint32_t k, void* data);
+  std::vector<if_channel_t*> channels;
+  HoS::worker_pool_t* pool;
   float tau_gain;
   float extgain;
-  bool b_invert;
   int32_t debugchannel;
+  // buffers of the current block, used by process_channel:
+  jack_nframes_t cur_n;
+  const std::vector<float*>* cur_in;
+  const std::vector<float*>* cur_out;
 };
 
 if_filter_t::if_filter_t(const std::string& server_addr,
                          const std::string& server_port,
-                         const std::string& jackname, uint32_t fragsize)
+                         const std::string& jackname, uint32_t fragsize,
+                         uint32_t nchannels, uint32_t nthreads)
     : jackc_db_t(jackname, fragsize), TASCAR::osc_server_t(server_addr,
                                                            server_port, "UDP"),
-      ola(4 * fragsize, 2 * fragsize, fragsize, TASCAR::stft_t::WND_HANNING,
-          TASCAR::stft_t::WND_HANNING, 0.5),
-      dtfft(4 * fragsize, 2 * fragsize, fragsize, TASCAR::stft_t::WND_HANNING,
-            0.5),
-      d1(fragsize), ifscale(-srate / (PI2)),
-      mean_lp(ola.s.n_, srate / (double)fragsize),
-      std_lp(ola.s.n_, srate / (double)fragsize),
-      pow_lp(2, srate / (double)fragsize), sigma0(30.0), tau_std(0.05),
-      tau_gain(0.4), extgain(1.0), b_invert(false), debugchannel(4)
+      pool(NULL), tau_gain(0.4), extgain(1.0), debugchannel(4), cur_n(0),
+      cur_in(NULL), cur_out(NULL)
 {
+  if(nchannels == 0)
+    throw TASCAR::ErrMsg("At least one channel is required.");
+  for(uint32_t k = 0; k < nchannels; ++k)
+    channels.push_back(new if_channel_t(fragsize, srate));
+  int prio(jack_client_real_time_priority(jc));
+  pool = new HoS::worker_pool_t(std::min(nthreads, nchannels),
+                                std::max(0, prio - 1));
   set_prefix("/" + jackname + "/");
   add_bool_true("quit", &b_quit);
-  add_float("sigma", &sigma0);
-  add_float("tau", &tau_std);
+  add_method("sigma", "f", if_filter_t::osc_set_sigma, this);
+  add_method("tau", "f", if_filter_t::osc_set_tau, this);
+  add_method("invert", "i", if_filter_t::osc_set_invert, this);
   add_float("taugain", &tau_gain);
   add_float_db("gain", &extgain);
-  add_bool("invert", &b_invert);
   add_int("debug", &debugchannel);
-  add_input_port("in");
-  add_output_port("out");
+  if(nchannels == 1) {
+    add_input_port("in");
+    add_output_port("out");
+  } else {
+    for(uint32_t k = 0; k < nchannels; ++k) {
+      std::string num(std::to_string(k + 1));
+      add_float(num + "/sigma", &(channels[k]->sigma0));
+      add_float(num + "/tau", &(channels[k]->tau_std));
+      add_bool(num + "/invert", &(channels[k]->b_invert));
+      add_input_port("in." + num);
+      add_output_port("out." + num);
+    }
+  }
+}
+
+if_filter_t::~if_filter_t()
+{
+  delete pool;
+  for(auto ch : channels)
+    delete ch;
+}
+
+int if_filter_t::osc_set_sigma(const char* path, const char* types,
+                               lo_arg** argv, int argc, lo_message msg,
+                               void* user_data)
+{
+  if(user_data && (argc == 1) && (types[0] == 'f'))
+    for(auto ch : ((if_filter_t*)user_data)->channels)
+      ch->sigma0 = argv[0]->f;
+  return 0;
+}
+
+int if_filter_t::osc_set_tau(const char* path, const char* types,
+                             lo_arg** argv, int argc, lo_message msg,
+                             void* user_data)
+{
+  if(user_data && (argc == 1) && (types[0] == 'f'))
+    for(auto ch : ((if_filter_t*)user_data)->channels)
+      ch->tau_std = argv[0]->f;
+  return 0;
+}
+
+int if_filter_t::osc_set_invert(const char* path, const char* types,
+                                lo_arg** argv, int argc, lo_message msg,
+                                void* user_data)
+{
+  if(user_data && (argc == 1) && (types[0] == 'i'))
+    for(auto ch : ((if_filter_t*)user_data)->channels)
+      ch->b_invert = (argv[0]->i != 0);
+  return 0;
 }
 
 void if_filter_t::activate()
@@ -102,51 +221,24 @@ void if_filter_t::deactivate()
   jackc_t::deactivate();
 }
 
-float sqr(float x)
+void if_filter_t::process_channel(uint32_t k, void* data)
 {
-  return x * x;
+  if_filter_t* self((if_filter_t*)data);
+  TASCAR::wave_t w_in(self->cur_n, (*self->cur_in)[k]);
+  TASCAR::wave_t w_out(self->cur_n, (*self->cur_out)[k]);
+  self->channels[k]->process(w_in, w_out, self->tau_gain, self->extgain);
 }
 
 int if_filter_t::inner_process(jack_nframes_t n,
                                const std::vector<float*>& inBuf,
                                const std::vector<float*>& outBuf)
 {
-  if((inBuf.size() == 0) || (outBuf.size() == 0))
+  if((inBuf.size() < channels.size()) || (outBuf.size() < channels.size()))
     return 1;
-  TASCAR::wave_t w_in(n, inBuf[0]);
-  TASCAR::wave_t w_out(n, outBuf[0]);
-  float sigma0_corr(0.69315f / sigma0);
-  mean_lp.set_lowpass(tau_std);
-  std_lp.set_lowpass(tau_std);
-  pow_lp.set_lowpass(tau_gain);
-  d1.process(w_in);
-  ola.process(w_in);
-  dtfft.process(d1);
-  double pow_in(1e-20);
-  double pow_out(1e-20);
-  for(unsigned int k = 0; k < dtfft.s.n_; k++) {
-    dtfft.s.b[k] *= conj(ola.s.b[k]);
-    float ifreq(std::arg(dtfft.s.b[k]) * ifscale);
-    float ifreq_mean(mean_lp.filter(k, ifreq));
-    float ifreq_diff(ifreq_mean - ifreq);
-    ifreq_diff *= ifreq_diff;
-    float ifreq_std(sqrtf(std::max(0.0f, std_lp.filter(k, ifreq_diff))));
-    float gain = 1.0f - expf(-ifreq_std * sigma0_corr);
-    // if( k==debugchannel ){
-    //  std::cout << ifreq << " " << ifreq_mean << " " << ifreq_std << " " <<
-    //  gain << "\n";
-    //}
-    if(gain < 1e-4)
-      gain = 1e-4;
-    if(b_invert)
-      gain = 1.0 - gain;
-    pow_in += sqr(std::abs(ola.s[k]));
-    ola.s[k] *= gain;
-    pow_out += sqr(std::abs(ola.s[k]));
-  }
-  float bbgain(sqrtf(pow_lp.filter(0, pow_in) / pow_lp.filter(1, pow_out)));
-  ola.s *= (bbgain * extgain);
-  ola.ifft(w_out);
+  cur_n = n;
+  cur_in = &inBuf;
+  cur_out = &outBuf;
+  pool->run(channels.size(), &if_filter_t::process_channel, this);
   return 0;
 }
 
@@ -174,11 +266,14 @@ int main(int argc, char** argv)
   uint32_t periodsize(512);
   std::string serverport("6978");
   std::string serveraddr("239.255.1.7");
-  const char* options = "hj:s:m:p:";
+  uint32_t channels(1);
+  uint32_t nthreads(std::max(1u, std::thread::hardware_concurrency()));
+  const char* options = "hj:s:m:p:c:t:";
   struct option long_options[] = {
       {"help", 0, 0, 'h'},       {"jackname", 1, 0, 'j'},
       {"periodsize", 1, 0, 's'}, {"multicast", 1, 0, 'm'},
-      {"port", 1, 0, 'p'},       {0, 0, 0, 0}};
+      {"port", 1, 0, 'p'},       {"channels", 1, 0, 'c'},
+      {"threads", 1, 0, 't'},    {0, 0, 0, 0}};
   int opt(0);
   int option_index(0);
   while((opt = getopt_long(argc, argv, options, long_options, &option_index)) !=
@@ -199,9 +294,16 @@ int main(int argc, char** argv)
     case 'm':
       serveraddr = optarg;
       break;
+    case 'c':
+      channels = atoi(optarg);
+      break;
+    case 't':
+      nthreads = atoi(optarg);
+      break;
     }
   }
-  if_filter_t iff(serveraddr, serverport, jackname, periodsize);
+  if_filter_t iff(serveraddr, serverport, jackname, periodsize, channels,
+                  nthreads);
   iff.activate();
   while(!b_quit) {
     sleep(1);
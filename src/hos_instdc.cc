@@ -1,4 +1,4 @@
-#include "libhos_audiochunks.h"
+#include "libhos_spksim.h"
 #include <getopt.h>
 #include <iostream>
 #include <math.h>
@@ -14,25 +14,32 @@ class dc_t : public jackc_t, public TASCAR::osc_server_t {
 public:
   dc_t(const std::string& jackname, const std::string& server_address,
        const std::string& server_port, const std::vector<std::string>& names,
-       float c, float fc);
+       float c, float fc, uint32_t oversampling);
   int process(jack_nframes_t n, const std::vector<float*>& inBuf,
               const std::vector<float*>& outBuf);
+  void print_load();
 
 private:
   float c_;
   float fcut;
-  double c1;
-  double c2;
-  TASCAR::wave_t statex;
-  TASCAR::wave_t statey;
+  // parameters of the current coefficients:
+  float c_used;
+  float fcut_used;
+  HoS::spksim_t spk;
 };
 
 dc_t::dc_t(const std::string& jackname, const std::string& server_address,
            const std::string& server_port,
-           const std::vector<std::string>& names, float c, float fc)
+           const std::vector<std::string>& names, float c, float fc,
+           uint32_t oversampling)
     : jackc_t(jackname), osc_server_t(server_address, server_port, "UDP"),
-      c_(c), fcut(fc), statex(names.size()), statey(names.size())
+      c_(c), fcut(fc), c_used(c), fcut_used(fc),
+      spk(names.size(), srate, oversampling)
 {
+  spk.set_resonance(0.0, 0.0);
+  spk.set_lowpass(fcut);
+  spk.set_clipping(c_);
+  spk.set_differentiator(true, false);
   for(uint32_t k = 0; k < names.size(); k++) {
     add_input_port("in." + names[k]);
     add_output_port("out." + names[k]);
@@ -45,25 +52,26 @@ dc_t::dc_t(const std::string& jackname, const std::string& server_address,
 int dc_t::process(jack_nframes_t n, const std::vector<float*>& inBuf,
                   const std::vector<float*>& outBuf)
 {
-  if(fcut > 0) {
-    c1 = exp(-fcut / srate);
-    c2 = 1.0 - c1;
+  // the coefficients are updated only if the parameters changed:
+  if((fcut != fcut_used) && (fcut > 0)) {
+    fcut_used = fcut;
+    spk.set_lowpass(fcut_used);
   }
-  for(uint32_t ch = 0; ch < inBuf.size(); ch++) {
-    for(uint32_t k = 0; k < n; k++) {
-      float v(inBuf[ch][k]);
-      v -= statex[ch];
-      statex[ch] = inBuf[ch][k];
-      v = v * c_ / (c_ + fabsf(v));
-      statey[ch] *= c1;
-      statey[ch] += c2 * v;
-      v = statey[ch];
-      outBuf[ch][k] = v;
-    }
+  if(c_ != c_used) {
+    c_used = c_;
+    spk.set_clipping(c_used);
   }
+  spk.process(n, inBuf, outBuf);
   return 0;
 }
 
+void dc_t::print_load()
+{
+  std::cout << "oversampling " << spk.oversampling() << ", latency "
+            << spk.latency() << " samples, CPU load " << 100.0 * spk.cpu_load()
+            << "%" << std::endl;
+}
+
 static void sighandler(int sig)
 {
   b_quit = true;
@@ -92,12 +100,15 @@ int main(int argc, char** argv)
   std::string jackname("instdc");
   float c(0.5);
   float fcut(1200);
+  uint32_t oversampling(1);
+  bool loadreport(false);
   std::vector<std::string> objnames;
-  const char* options = "hn:c:m:p:f:";
+  const char* options = "hn:c:m:p:f:o:l";
   struct option long_options[] = {
-      {"help", 0, 0, 'h'},  {"fcut", 1, 0, 'f'},
-      {"scale", 1, 0, 'c'}, {"multicast", 1, 0, 'm'},
-      {"port", 1, 0, 'p'},  {"jackname", 1, 0, 'n'},
+      {"help", 0, 0, 'h'},         {"fcut", 1, 0, 'f'},
+      {"scale", 1, 0, 'c'},        {"multicast", 1, 0, 'm'},
+      {"port", 1, 0, 'p'},         {"jackname", 1, 0, 'n'},
+      {"oversampling", 1, 0, 'o'}, {"loadreport", 0, 0, 'l'},
       {0, 0, 0, 0}};
   int opt(0);
   int option_index(0);
@@ -122,6 +133,12 @@ int main(int argc, char** argv)
     case 'n':
       jackname = optarg;
       break;
+    case 'o':
+      oversampling = atoi(optarg);
+      break;
+    case 'l':
+      loadreport = true;
+      break;
     }
   }
   while(optind < argc)
@@ -129,11 +146,16 @@ int main(int argc, char** argv)
   if(objnames.empty()) {
     objnames.push_back("0");
   }
-  dc_t dc(jackname, serveraddr, serverport, objnames, c, fcut);
+  dc_t dc(jackname, serveraddr, serverport, objnames, c, fcut, oversampling);
   dc.jackc_t::activate();
   dc.osc_server_t::activate();
-  while(!b_quit)
+  uint32_t t(0);
+  while(!b_quit) {
     sleep(1);
+    // report CPU load every 5 seconds:
+    if(loadreport && ((++t % 5) == 0))
+      dc.print_load();
+  }
   dc.jackc_t::deactivate();
   dc.osc_server_t::deactivate();
   return 0;
@@ -206,12 +206,12 @@ void osc2jack_t::run()
     connect_out(0, "mha-house:cv_bass", true);
     connect_out(1, "mha-house:cv_mid", true);
     connect_out(2, "mha-house:cv_high", true);
-    connect_out(6, "resflt1:f", true);
-    connect_out(7, "resflt1:q", true);
-    connect_out(8, "resflt2:f", true);
-    connect_out(9, "resflt2:q", true);
-    connect_out(10, "resflt3:f", true);
-    connect_out(11, "resflt3:q", true);
+    connect_out(6, "resflt:resflt1.f", true);
+    connect_out(7, "resflt:resflt1.q", true);
+    connect_out(8, "resflt:resflt2.f", true);
+    connect_out(9, "resflt:resflt2.q", true);
+    connect_out(10, "resflt:resflt3.f", true);
+    connect_out(11, "resflt:resflt3.q", true);
   }
   while(!b_quit)
     usleep(50000);
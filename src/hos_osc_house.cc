@@ -1,69 +1,272 @@
 #include "hos_defs.h"
+#include "rampedvalue.h"
+#include "spscqueue.h"
+#include "triplebuffer.h"
 #include <fstream>
 #include <getopt.h>
 #include <iostream>
+#include <libxml++/libxml++.h>
 #include <math.h>
 #include <signal.h>
-#include <stdio.h>
+#include <sstream>
 #include <stdlib.h>
-#include <string.h>
 #include <tascar/errorhandling.h>
 #include <tascar/jackclient.h>
 #include <tascar/osc_helper.h>
 #include <unistd.h>
 
+/// Number of points of the modulation tables:
+#define SHAPE_LEN 512
+
 static bool b_quit;
 
-class matrix_t {
+/**
+   \brief Output port of the sequencer
+
+   The level of the output is the value of one column of the current
+   step, multiplied with the gain of a fader. It can be modulated
+   within each bar by a cosine or sine shape.
+ */
+class seq_output_t {
+public:
+  enum shape_t { SHAPE_CONST, SHAPE_COS, SHAPE_SIN };
+  seq_output_t()
+      : column(0), fader(0), shape(SHAPE_CONST), offset(0.0f), depth(1.0f){};
+  std::string name;
+  std::string connect;
+  /// Column of the step values, starting at 0:
+  uint32_t column;
+  /// Gain fader, starting at 1, or 0 for no fader:
+  uint32_t fader;
+  shape_t shape;
+  /// Modulation is offset + depth * shape(phase):
+  float offset;
+  float depth;
+};
+
+/**
+   \brief Sequencer configuration, with step values preprocessed into
+   per-bar levels
+
+   Each preset has a sequence of steps, one step per bar. Each step
+   has a number of columns. Presets with less steps than the sequence
+   length are repeated.
+ */
+class sequence_t {
+public:
+  sequence_t();
+  void read_xml(const std::string& fname);
+  /// Levels of all outputs in one step of a preset:
+  const float* level(uint32_t preset, uint32_t step) const
+  {
+    return &(levels[(preset * steps + step) * outputs.size()]);
+  };
+  /// Number of gain faders:
+  uint32_t faders() const;
+  std::vector<seq_output_t> outputs;
+  std::string time_port;
+  uint32_t beatsperbar;
+  uint32_t steps;
+  uint32_t presets;
+  /// Levels of all outputs, for each preset and step:
+  std::vector<float> levels;
+
+private:
+  void add_preset(const std::vector<std::vector<float>>& values);
+};
+
+/**
+   \brief Entry of the log, written by the audio thread
+ */
+class seq_log_t {
 public:
-  matrix_t();
-  matrix_t(const matrix_t& src);
-  void load(const std::string& fname);
-  inline void set(uint32_t t, uint32_t ch, float v) { m[ch * 16 + t] = v; };
-  inline float get(uint32_t t, uint32_t ch) { return m[ch * 16 + t]; };
-  float m[96];
+  int32_t bar;
+  int32_t step;
+  uint32_t preset;
 };
 
-matrix_t::matrix_t()
+static std::string get_attribute(xmlpp::Element* e, const std::string& name,
+                                 const std::string& def)
 {
-  memset(m, 0, 96 * sizeof(float));
+  std::string val(e->get_attribute_value(name));
+  if(val.empty())
+    return def;
+  return val;
 }
 
-matrix_t::matrix_t(const matrix_t& src)
+static double get_attribute(xmlpp::Element* e, const std::string& name,
+                            double def)
 {
-  for(uint32_t k = 0; k < 96; k++)
-    m[k] = src.m[k];
+  std::string val(e->get_attribute_value(name));
+  if(val.empty())
+    return def;
+  return atof(val.c_str());
 }
 
-void matrix_t::load(const std::string& fname)
+static std::vector<float> str2vec(const std::string& s)
 {
-  std::ifstream fh(fname.c_str());
-  uint32_t t(0);
-  while(!fh.eof()) {
-    char ctmp[1024];
-    memset(ctmp, 0, 1024);
-    fh.getline(ctmp, 1023);
-    float d[6];
-    memset(d, 0, 6 * sizeof(float));
-    if(sscanf(ctmp, "%f %f %f %f %f %f", &(d[0]), &(d[1]), &(d[2]), &(d[3]),
-              &(d[4]), &(d[5])) == 6) {
-      if(t < 16) {
-        for(uint32_t ch = 0; ch < 6; ch++)
-          set(t, ch, d[ch]);
-        t++;
+  std::vector<float> v;
+  std::istringstream is(s);
+  float x;
+  while(is >> x)
+    v.push_back(x);
+  return v;
+}
+
+sequence_t::sequence_t()
+    : time_port("mha-house:time"), beatsperbar(4), steps(16), presets(0)
+{
+  // layout of the Harmony of the Spheres house installation:
+  const char* names[9] = {"cv_bass", "cv_mid", "cv_high", "cv_echo",
+                          "cv_detone", "f1", "q1", "f2", "q2"};
+  const char* ports[9] = {"mha-house:cv_bass",     "mha-house:cv_mid",
+                          "mha-house:cv_high",     "mha-sigproc:cv_delay",
+                          "mha-sigproc:cv_detone", "resflt:resflt1.f",
+                          "resflt:resflt1.q",      "resflt:resflt2.f",
+                          "resflt:resflt2.q"};
+  for(uint32_t k = 0; k < 9; ++k) {
+    seq_output_t o;
+    o.name = names[k];
+    o.connect = ports[k];
+    o.column = std::min(k, 5u);
+    o.fader = (k < 5) ? (k + 1) : 0;
+    outputs.push_back(o);
+  }
+  for(uint32_t k = 5; k < 9; k += 2) {
+    outputs[k].shape = seq_output_t::SHAPE_COS;
+    outputs[k].offset = 0.5f;
+    outputs[k].depth = 0.5f;
+    outputs[k + 1].shape = seq_output_t::SHAPE_SIN;
+    outputs[k + 1].offset = 0.5f;
+    outputs[k + 1].depth = 0.4f;
+    outputs[k + 1].fader = 6;
+  }
+}
+
+uint32_t sequence_t::faders() const
+{
+  uint32_t n(0);
+  for(auto& o : outputs)
+    n = std::max(n, o.fader);
+  return n;
+}
+
+void sequence_t::add_preset(const std::vector<std::vector<float>>& values)
+{
+  if(values.empty())
+    throw TASCAR::ErrMsg("Preset without steps.");
+  for(uint32_t s = 0; s < steps; ++s) {
+    const std::vector<float>& v(values[s % values.size()]);
+    for(auto& o : outputs)
+      levels.push_back((o.column < v.size()) ? v[o.column] : 0.0f);
+  }
+  ++presets;
+}
+
+/**
+   \brief Read configuration and presets
+
+   Example:
+
+   \verbatim
+   <sequencer steps="16" beatsperbar="4" time="mha-house:time">
+     <output name="cv_bass" connect="mha-house:cv_bass" column="1"
+             fader="1"/>
+     <output name="f1" connect="resflt:resflt1.f" column="6" shape="cos"
+             offset="0.5" depth="0.5"/>
+     <preset>
+       <step v="1 0 0.5 0 0 1"/>
+       <step v="0 1 0.5 0 0 0"/>
+     </preset>
+     <preset file="preset2.txt"/>
+   </sequencer>
+   \endverbatim
+
+   Columns and faders start at 1. A preset file has one step per line,
+   with whitespace separated values.
+ */
+void sequence_t::read_xml(const std::string& fname)
+{
+  xmlpp::DomParser parser(fname);
+  xmlpp::Element* root(parser.get_document()->get_root_node());
+  if(!root)
+    throw TASCAR::ErrMsg("Invalid sequencer file \"" + fname + "\".");
+  time_port = get_attribute(root, "time", time_port);
+  double bpb(get_attribute(root, "beatsperbar", 4.0));
+  double nsteps(get_attribute(root, "steps", 16.0));
+  if((bpb < 1) || (nsteps < 1))
+    throw TASCAR::ErrMsg("Invalid number of steps or beats per bar.");
+  beatsperbar = bpb;
+  steps = nsteps;
+  outputs.clear();
+  for(auto& node : root->get_children("output")) {
+    xmlpp::Element* e(dynamic_cast<xmlpp::Element*>(node));
+    if(e) {
+      seq_output_t o;
+      o.name = get_attribute(e, "name", "out" + std::to_string(outputs.size()));
+      o.connect = get_attribute(e, "connect", "");
+      int32_t col(get_attribute(e, "column", outputs.size() + 1));
+      if(col < 1)
+        throw TASCAR::ErrMsg("Invalid column of output " + o.name + ".");
+      o.column = col - 1;
+      o.fader = std::max(0.0, get_attribute(e, "fader", 0.0));
+      std::string shape(get_attribute(e, "shape", "const"));
+      if(shape == "cos")
+        o.shape = seq_output_t::SHAPE_COS;
+      else if(shape == "sin")
+        o.shape = seq_output_t::SHAPE_SIN;
+      else if(shape != "const")
+        throw TASCAR::ErrMsg("Invalid shape \"" + shape + "\".");
+      o.offset = get_attribute(e, "offset", 0.0);
+      o.depth = get_attribute(e, "depth", 1.0);
+      outputs.push_back(o);
+    }
+  }
+  if(outputs.empty())
+    throw TASCAR::ErrMsg("No outputs in sequencer file \"" + fname + "\".");
+  presets = 0;
+  levels.clear();
+  for(auto& node : root->get_children("preset")) {
+    xmlpp::Element* e(dynamic_cast<xmlpp::Element*>(node));
+    if(e) {
+      std::vector<std::vector<float>> values;
+      std::string pfname(e->get_attribute_value("file"));
+      if(!pfname.empty()) {
+        std::ifstream fh(pfname.c_str());
+        if(!fh.good())
+          throw TASCAR::ErrMsg("Unable to open preset file \"" + pfname +
+                               "\".");
+        std::string line;
+        while(std::getline(fh, line)) {
+          std::vector<float> v(str2vec(line));
+          if(!v.empty())
+            values.push_back(v);
+        }
       }
+      for(auto& snode : e->get_children("step")) {
+        xmlpp::Element* es(dynamic_cast<xmlpp::Element*>(snode));
+        if(es)
+          values.push_back(str2vec(es->get_attribute_value("v")));
+      }
+      add_preset(values);
     }
   }
-  for(uint32_t k = t; k < 16; k++)
-    for(uint32_t ch = 0; ch < 6; ch++)
-      set(k, ch, get(k - t, ch));
 }
 
+/**
+   \brief Control voltage sequencer, synchronised to the bars of a time
+   signal
+
+   The time input is in beats. Within each block, the samples are
+   grouped into segments of constant bar; the levels of the current
+   step change only at bar boundaries. The outputs are filled segment
+   by segment. Bar changes are logged via a queue, which is emptied
+   by the main thread.
+ */
 class osc_house_t : public jackc_t, public TASCAR::osc_server_t {
 public:
-  osc_house_t(const std::vector<std::string>& names,
-              const std::string& multicast, const std::string& serverport,
-              const std::string& jackname);
+  osc_house_t(const std::string& fname, const std::string& multicast,
+              const std::string& serverport, const std::string& jackname);
   ~osc_house_t();
   void run();
   int process(jack_nframes_t nframes, const std::vector<float*>& inBuffer,
@@ -72,164 +275,95 @@ public:
                         int argc, lo_message msg, void* user_data);
   static int osc_select(const char* path, const char* types, lo_arg** argv,
                         int argc, lo_message msg, void* user_data);
-  static int osc_set_gain0(const char* path, const char* types, lo_arg** argv,
-                           int argc, lo_message msg, void* user_data);
-  static int osc_set_gain1(const char* path, const char* types, lo_arg** argv,
-                           int argc, lo_message msg, void* user_data);
-  static int osc_set_gain2(const char* path, const char* types, lo_arg** argv,
-                           int argc, lo_message msg, void* user_data);
-  static int osc_set_gain3(const char* path, const char* types, lo_arg** argv,
-                           int argc, lo_message msg, void* user_data);
-  static int osc_set_gain4(const char* path, const char* types, lo_arg** argv,
-                           int argc, lo_message msg, void* user_data);
-  static int osc_set_gain5(const char* path, const char* types, lo_arg** argv,
-                           int argc, lo_message msg, void* user_data);
-  void set_gain(float newgain, double duration, uint32_t k)
-  {
-    dgain[k] = (newgain - gain[k]) / (duration * srate);
-    tfader[k] = srate * duration;
-  };
   void reload();
   void select(uint32_t p);
 
 private:
+  void fill(const sequence_t& seq, uint32_t k0, uint32_t n,
+            const std::vector<float*>& outBuffer);
+  std::string fname;
+  sequence_t seq0;
+  HoS::triple_buffer_t<sequence_t> sequences;
+  HoS::spsc_queue_t<seq_log_t> log;
+  std::atomic<int32_t> preset_request;
   int32_t bar;
   int32_t bar_shifted;
-  float current[6];
-  std::vector<matrix_t> presets;
   uint32_t preset;
   int32_t offset;
-  std::vector<std::string> fnames;
-  float v_f1[512];
-  float v_q1[512];
-  float v_f2[512];
-  float v_q2[512];
-  double gain[6];
-  double dgain[6];
-  uint32_t tfader[6];
+  std::vector<float> current;
+  std::vector<HoS::ramped_value_t<float>*> gain;
+  // modulation shapes, with one extra point for interpolation:
+  std::vector<float> tab_cos;
+  std::vector<float> tab_sin;
+  // block buffers:
+  std::vector<int32_t> vbar;
+  std::vector<float> vphase;
+  std::vector<float> vcos;
+  std::vector<float> vsin;
+  std::vector<float> vone;
+  std::vector<float> vgain;
 };
 
-int osc_house_t::osc_set_gain0(const char* path, const char* types,
-                               lo_arg** argv, int argc, lo_message msg,
-                               void* user_data)
+static sequence_t read_sequence(const std::string& fname)
 {
-  if((user_data) && (argc == 2) && (types[0] == 'f') && (types[1] == 'f')) {
-    ((osc_house_t*)user_data)->set_gain(argv[0]->f, argv[1]->f, 0);
-  }
-  return 0;
-}
-
-int osc_house_t::osc_set_gain1(const char* path, const char* types,
-                               lo_arg** argv, int argc, lo_message msg,
-                               void* user_data)
-{
-  if((user_data) && (argc == 2) && (types[0] == 'f') && (types[1] == 'f')) {
-    ((osc_house_t*)user_data)->set_gain(argv[0]->f, argv[1]->f, 1);
-  }
-  return 0;
-}
-
-int osc_house_t::osc_set_gain2(const char* path, const char* types,
-                               lo_arg** argv, int argc, lo_message msg,
-                               void* user_data)
-{
-  if((user_data) && (argc == 2) && (types[0] == 'f') && (types[1] == 'f')) {
-    ((osc_house_t*)user_data)->set_gain(argv[0]->f, argv[1]->f, 2);
-  }
-  return 0;
-}
-
-int osc_house_t::osc_set_gain3(const char* path, const char* types,
-                               lo_arg** argv, int argc, lo_message msg,
-                               void* user_data)
-{
-  if((user_data) && (argc == 2) && (types[0] == 'f') && (types[1] == 'f')) {
-    ((osc_house_t*)user_data)->set_gain(argv[0]->f, argv[1]->f, 3);
-  }
-  return 0;
-}
-
-int osc_house_t::osc_set_gain4(const char* path, const char* types,
-                               lo_arg** argv, int argc, lo_message msg,
-                               void* user_data)
-{
-  if((user_data) && (argc == 2) && (types[0] == 'f') && (types[1] == 'f')) {
-    ((osc_house_t*)user_data)->set_gain(argv[0]->f, argv[1]->f, 4);
-  }
-  return 0;
-}
-
-int osc_house_t::osc_set_gain5(const char* path, const char* types,
-                               lo_arg** argv, int argc, lo_message msg,
-                               void* user_data)
-{
-  if((user_data) && (argc == 2) && (types[0] == 'f') && (types[1] == 'f')) {
-    ((osc_house_t*)user_data)->set_gain(argv[0]->f, argv[1]->f, 5);
-  }
-  return 0;
+  sequence_t seq;
+  if(!fname.empty())
+    seq.read_xml(fname);
+  return seq;
 }
 
 void osc_house_t::select(uint32_t p)
 {
-  if(p < presets.size()) {
-    offset = bar + 1;
-    preset = p;
-  }
+  preset_request = p;
 }
 
 void osc_house_t::reload()
 {
-  for(uint32_t k = 0; k < presets.size(); k++)
-    presets[k].load(fnames[k]);
+  if(fname.empty())
+    return;
+  try {
+    sequence_t seq(read_sequence(fname));
+    if((seq.outputs.size() != seq0.outputs.size()) ||
+       (seq.faders() > seq0.faders()))
+      throw TASCAR::ErrMsg("The number of outputs and faders can not be "
+                           "changed by reloading.");
+    sequences.write_buffer() = seq;
+    sequences.publish();
+  }
+  catch(const std::exception& e) {
+    std::cerr << "Error: " << e.what() << std::endl;
+  }
 }
 
-osc_house_t::osc_house_t(const std::vector<std::string>& names,
+osc_house_t::osc_house_t(const std::string& fname_,
                          const std::string& multicast,
                          const std::string& serverport,
                          const std::string& jackname)
     : jackc_t(jackname), TASCAR::osc_server_t(multicast, serverport, "UDP"),
-      bar(0), bar_shifted(0), preset(0), offset(0), fnames(names)
+      fname(fname_), seq0(read_sequence(fname)), sequences(seq0), log(64),
+      preset_request(-1), bar(-1), bar_shifted(0), preset(0), offset(0),
+      current(seq0.outputs.size(), 0.0f), tab_cos(SHAPE_LEN + 1),
+      tab_sin(SHAPE_LEN + 1), vbar(fragsize), vphase(fragsize),
+      vcos(fragsize), vsin(fragsize), vone(fragsize, 1.0f),
+      vgain(seq0.faders() * fragsize)
 {
-  memset(current, 0, 6 * sizeof(float));
-  presets.resize(fnames.size());
-  reload();
-  for(uint32_t k = 0; k < 512; k++) {
-    v_f1[k] = 0.5 + 0.5 * cos(PI2 * k / 512.0);
-    v_q1[k] = 0.5 + 0.4 * sin(PI2 * k / 512.0);
-    v_f2[k] = v_f1[k];
-    v_q2[k] = v_q1[k];
-  }
-  for(uint32_t k = 0; k < 6; k++) {
-    gain[k] = 1.0;
-    dgain[k] = 0.0;
-    tfader[k] = 0;
+  for(uint32_t k = 0; k <= SHAPE_LEN; k++) {
+    tab_cos[k] = cos(PI2 * k / SHAPE_LEN);
+    tab_sin[k] = sin(PI2 * k / SHAPE_LEN);
   }
   std::string prefix("/" + jackname + "/");
   add_input_port("time");
-  add_output_port("cv_bass");
-  add_output_port("cv_mid");
-  add_output_port("cv_high");
-  add_output_port("cv_echo");
-  add_output_port("cv_detone");
-  add_output_port("f1");
-  add_output_port("q1");
-  add_output_port("f2");
-  add_output_port("q2");
+  for(auto& o : seq0.outputs)
+    add_output_port(o.name);
   add_bool_true(prefix + "quit", &b_quit);
   add_method(prefix + "reload", "", osc_reload, this);
   add_method(prefix + "select", "i", osc_select, this);
-  add_double(prefix + "gain1", &(gain[0]));
-  add_method(prefix + "gain1", "ff", osc_house_t::osc_set_gain0, this);
-  add_double(prefix + "gain2", &(gain[1]));
-  add_method(prefix + "gain2", "ff", osc_house_t::osc_set_gain1, this);
-  add_double(prefix + "gain3", &(gain[2]));
-  add_method(prefix + "gain3", "ff", osc_house_t::osc_set_gain2, this);
-  add_double(prefix + "gain4", &(gain[3]));
-  add_method(prefix + "gain4", "ff", osc_house_t::osc_set_gain3, this);
-  add_double(prefix + "gain5", &(gain[4]));
-  add_method(prefix + "gain5", "ff", osc_house_t::osc_set_gain4, this);
-  add_double(prefix + "gain6", &(gain[5]));
-  add_method(prefix + "gain6", "ff", osc_house_t::osc_set_gain5, this);
+  for(uint32_t k = 0; k < seq0.faders(); k++) {
+    gain.push_back(new HoS::ramped_value_t<float>(1.0f, srate));
+    std::string path(prefix + "gain" + std::to_string(k + 1));
+    add_method(path, "d", HoS::osc_set_ramp<float>, gain.back());
+    add_method(path, "ff", HoS::osc_set_ramp<float>, gain.back());
+  }
 }
 
 int osc_house_t::osc_reload(const char* path, const char* types, lo_arg** argv,
@@ -243,74 +377,112 @@ int osc_house_t::osc_reload(const char* path, const char* types, lo_arg** argv,
 int osc_house_t::osc_select(const char* path, const char* types, lo_arg** argv,
                             int argc, lo_message msg, void* user_data)
 {
-  if(user_data && (argc == 1) && (types[0] == 'i'))
+  if(user_data && (argc == 1) && (types[0] == 'i') && (argv[0]->i >= 0))
     ((osc_house_t*)user_data)->select(argv[0]->i);
   return 0;
 }
 
-osc_house_t::~osc_house_t() {}
+osc_house_t::~osc_house_t()
+{
+  for(auto g : gain)
+    delete g;
+}
 
 void osc_house_t::run()
 {
   jackc_t::activate();
   TASCAR::osc_server_t::activate();
-  connect_in(0, "mha-house:time", true);
-  connect_out(0, "mha-house:cv_bass", true);
-  connect_out(1, "mha-house:cv_mid", true);
-  connect_out(2, "mha-house:cv_high", true);
-  connect_out(3, "mha-sigproc:cv_delay", true);
-  connect_out(4, "mha-sigproc:cv_detone", true);
-  connect_out(5, "resflt1:f", true);
-  connect_out(6, "resflt1:q", true);
-  connect_out(7, "resflt2:f", true);
-  connect_out(8, "resflt2:q", true);
-  while(!b_quit)
+  connect_in(0, seq0.time_port, true);
+  for(uint32_t k = 0; k < seq0.outputs.size(); ++k)
+    if(!seq0.outputs[k].connect.empty())
+      connect_out(k, seq0.outputs[k].connect, true);
+  seq_log_t entry;
+  while(!b_quit) {
     usleep(50000);
+    while(log.pop(entry))
+      std::cerr << "bar: " << entry.bar << "/" << entry.step
+                << " preset: " << entry.preset << "\n";
+  }
   TASCAR::osc_server_t::deactivate();
   jackc_t::deactivate();
 }
 
+void osc_house_t::fill(const sequence_t& seq, uint32_t k0, uint32_t n,
+                       const std::vector<float*>& outBuffer)
+{
+  for(uint32_t o = 0; o < seq.outputs.size(); ++o) {
+    const seq_output_t& op(seq.outputs[o]);
+    float* y(outBuffer[o] + k0);
+    const float* g(op.fader ? &(vgain[(op.fader - 1) * fragsize + k0])
+                            : &(vone[k0]));
+    const float level(current[o]);
+    if(op.shape == seq_output_t::SHAPE_CONST) {
+      for(uint32_t k = 0; k < n; ++k)
+        y[k] = level * g[k];
+    } else {
+      const float* m((op.shape == seq_output_t::SHAPE_COS) ? &(vcos[k0])
+                                                           : &(vsin[k0]));
+      const float c0(level * op.offset);
+      const float c1(level * op.depth);
+      for(uint32_t k = 0; k < n; ++k)
+        y[k] = (c0 + c1 * m[k]) * g[k];
+    }
+  }
+}
+
 int osc_house_t::process(jack_nframes_t nframes,
                          const std::vector<float*>& inBuffer,
                          const std::vector<float*>& outBuffer)
 {
-  for(uint32_t k = 0; k < nframes; k++) {
-    for(uint32_t ch = 0; ch < 6; ch++)
-      if(tfader[ch]) {
-        gain[ch] += dgain[ch];
-        tfader[ch]--;
+  const sequence_t& seq(sequences.read());
+  int32_t p(preset_request.exchange(-1));
+  if(p >= 0) {
+    // new preset starts at the next bar:
+    offset = bar + 1;
+    preset = p;
+  }
+  for(uint32_t k = 0; k < gain.size(); ++k) {
+    gain[k]->update();
+    gain[k]->process(&(vgain[k * fragsize]), nframes);
+  }
+  // bar and phase within bar of each sample:
+  const float* vtime(inBuffer[0]);
+  const float barsperbeat(1.0f / seq.beatsperbar);
+  const int32_t lastbar(seq.steps - 1);
+  for(uint32_t k = 0; k < nframes; ++k) {
+    float time(barsperbeat * vtime[k]);
+    float nbar(floorf(time));
+    vphase[k] = time - nbar;
+    vbar[k] = std::min(lastbar, std::max(0, (int32_t)nbar));
+  }
+  // modulation shapes, linear interpolation of the tables:
+  for(uint32_t k = 0; k < nframes; ++k) {
+    float x(std::max(0.0f, std::min((float)SHAPE_LEN, vphase[k] * SHAPE_LEN)));
+    uint32_t i(std::min((uint32_t)x, SHAPE_LEN - 1u));
+    float w(x - i);
+    vcos[k] = tab_cos[i] + w * (tab_cos[i + 1] - tab_cos[i]);
+    vsin[k] = tab_sin[i] + w * (tab_sin[i + 1] - tab_sin[i]);
+  }
+  // segments of constant bar:
+  uint32_t k0(0);
+  while(k0 < nframes) {
+    uint32_t k1(k0 + 1);
+    while((k1 < nframes) && (vbar[k1] == vbar[k0]))
+      ++k1;
+    if(vbar[k0] != bar) {
+      bar = vbar[k0];
+      const int32_t steps(seq.steps);
+      bar_shifted = ((bar - offset) % steps + steps) % steps;
+      if(preset < seq.presets) {
+        const float* lv(seq.level(preset, bar_shifted));
+        for(uint32_t o = 0; o < current.size(); ++o)
+          current[o] = lv[o];
       }
-    float time(0.25 * inBuffer[0][k]);
-    int32_t nbar(time);
-    float phase(time - nbar);
-    uint32_t iphase(std::max(0.0f, std::min(511.0f, phase * 512.0f)));
-    nbar = std::min(15, std::max(0, nbar));
-    if(nbar != bar) {
-      bar = nbar;
-      bar_shifted = (bar - offset + 16) % 16;
-      if(preset < presets.size())
-        for(uint32_t ch = 0; ch < 6; ch++)
-          current[ch] = presets[preset].get(bar_shifted, ch);
-      std::cerr << current[0] << " " << current[1] << " " << current[2] << " "
-                << current[3] << " " << current[4] << " " << current[5]
-                << " bar: " << bar << "/" << bar_shifted
-                << " preset: " << preset << "\n";
+      // if the main thread is too slow, log entries are dropped:
+      log.push({bar, bar_shifted, preset});
     }
-    // ("cv_bass");
-    // ("cv_mid");
-    // ("cv_high");
-    // ("cv_echo");
-    // ("cv_detone");
-    // ("f1");
-    // ("q1");
-    // ("f2");
-    // ("q2");
-    for(uint32_t ch = 0; ch < 5; ch++)
-      outBuffer[ch][k] = current[ch] * gain[ch];
-    outBuffer[5][k] = v_f1[iphase] * current[5];
-    outBuffer[6][k] = v_q1[iphase] * current[5] * gain[5];
-    outBuffer[7][k] = v_f2[iphase] * current[5];
-    outBuffer[8][k] = v_q2[iphase] * current[5] * gain[5];
+    fill(seq, k0, k1 - k0, outBuffer);
+    k0 = k1;
   }
   return 0;
 }
@@ -322,8 +494,9 @@ static void sighandler(int sig)
 
 void usage(struct option* opt)
 {
-  std::cout
-      << "Usage:\n\nhos_osc2jack [options] path [ path .... ]\n\nOptions:\n\n";
+  std::cout << "Usage:\n\nhos_osc_house [options] [sequencer.xml]\n\n"
+               "Without a sequencer file, the default output layout is used "
+               "without presets.\n\nOptions:\n\n";
   while(opt->name) {
     std::cout << "  -" << (char)(opt->val) << " " << (opt->has_arg ? "#" : "")
               << "\n  --" << opt->name << (opt->has_arg ? "=#" : "") << "\n\n";
@@ -340,7 +513,7 @@ int main(int argc, char** argv)
   std::string jackname("osc2jack");
   std::string serverport("6978");
   std::string serveraddr("239.255.1.7");
-  std::vector<std::string> path;
+  std::string fname;
   const char* options = "hn:p:m:";
   struct option long_options[] = {{"help", 0, 0, 'h'},
                                   {"multicast", 1, 0, 'm'},
@@ -366,14 +539,11 @@ int main(int argc, char** argv)
       break;
     }
   }
-  while(optind < argc)
-    path.push_back(argv[optind++]);
-  // if( path.empty() ){
-  //  usage(long_options);
-  //  return -1;
-  //}
-  osc_house_t s(path, serveraddr, serverport, jackname);
+  if(optind < argc)
+    fname = argv[optind++];
+  osc_house_t s(fname, serveraddr, serverport, jackname);
   s.run();
+  return 0;
 }
 
 /*
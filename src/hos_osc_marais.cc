@@ -83,10 +83,10 @@ void osc_marais_t::run()
 {
   jackc_t::activate();
   TASCAR::osc_server_t::activate();
-  connect_out(0, "resflt1:f", true);
-  connect_out(1, "resflt1:q", true);
-  connect_out(2, "resflt2:f", true);
-  connect_out(3, "resflt2:q", true);
+  connect_out(0, "resflt:resflt1.f", true);
+  connect_out(1, "resflt:resflt1.q", true);
+  connect_out(2, "resflt:resflt2.f", true);
+  connect_out(3, "resflt:resflt2.q", true);
   connect_out(4, "mha-sigproc:cv_delay", true);
   connect_out(5, "mha-sigproc:cv_detone", true);
   while(!b_quit)
@@ -27,37 +27,99 @@
 #include "filter.h"
 #include "hos_defs.h"
 #include "libhos_audiochunks.h"
+#include "libhos_filterbank.h"
+#include "libhos_ifanalysis.h"
+#include "spscqueue.h"
+#include <atomic>
+#include <chrono>
 #include <getopt.h>
 #include <iostream>
 #include <signal.h>
 #include <stdlib.h>
+#include <tascar/errorhandling.h>
 #include <tascar/filterclass.h>
 #include <tascar/jackclient.h>
 #include <tascar/ola.h>
 #include <tascar/osc_helper.h>
+#include <thread>
 #include <unistd.h>
 
-std::complex<float> i_f = {0.0f, 1.0f};
-
 static bool b_quit(false);
 
+/**
+   \brief Colour of one analysis frame
+ */
+class hsv_frame_t {
+public:
+  float hue = 0.0f;
+  float sat = 0.0f;
+  float val = 0.0f;
+  /// JACK frame time of the analysis:
+  jack_nframes_t time = 0;
+};
+
+/**
+   \brief Linear interpolation of two frames, hue on the shorter arc
+ */
+static hsv_frame_t interpolate(const hsv_frame_t& a, const hsv_frame_t& b,
+                               float w)
+{
+  hsv_frame_t f;
+  float dhue(b.hue - a.hue);
+  if(dhue > 180.0f)
+    dhue -= 360.0f;
+  if(dhue < -180.0f)
+    dhue += 360.0f;
+  f.hue = a.hue + w * dhue;
+  if(f.hue < 0.0f)
+    f.hue += 360.0f;
+  if(f.hue >= 360.0f)
+    f.hue -= 360.0f;
+  f.sat = a.sat + w * (b.sat - a.sat);
+  f.val = a.val + w * (b.val - a.val);
+  return f;
+}
+
+/**
+   \brief Pitch to colour conversion
+
+   The analysis runs every hop (the fragment size of the double
+   buffer), with an FFT length independent of the hop size. The
+   colours are passed with their JACK frame time to a sender thread,
+   which sends them at a fixed rate. If the hop is longer than the
+   send period, the colour is rendered one hop in the past, by linear
+   interpolation between the two frames bracketing that time.
+   Otherwise, the mean of the frames received since the last send is
+   sent.
+
+   The pitch class intensities are either computed from the
+   instantaneous frequency of FFT bins, or from the power of
+   semitone-spaced constant-Q or gammatone bands.
+ */
 class pitch2colour_t : public jackc_db_t, public TASCAR::osc_server_t {
 public:
   pitch2colour_t(const std::string& server_addr, const std::string& server_port,
-                 const std::string& jackname, uint32_t fragsize,
-                 std::string const& url, std::string const& path, int p_scale);
+                 const std::string& jackname, uint32_t hopsize,
+                 uint32_t fftlen, float sendrate, std::string const& url,
+                 std::string const& path, int p_scale,
+                 HoS::bandmode_t bandmode);
+  ~pitch2colour_t();
   int inner_process(jack_nframes_t n, const std::vector<float*>& inBuf,
                     const std::vector<float*>& outBuf);
   void activate();
   void deactivate();
 
 private:
-  TASCAR::ola_t ola;
-  TASCAR::stft_t dtfft;
-  HoS::delay1_t d1;
-  float ifscale;
-  HoS::filter_array_t mean_lp;
-  HoS::filter_array_t std_lp;
+  void send_thread();
+  void fold_bins();
+  void fold_bands(const TASCAR::wave_t& power);
+  HoS::spsc_queue_t<hsv_frame_t> frames;
+  std::thread sender;
+  std::atomic<bool> b_run_sender;
+  float sendrate;
+  uint32_t hopsize;
+  TASCAR::stft_t stft;
+  HoS::if_analysis_t ifa;
   TASCAR::biquadf_t val_lp;
   float tau_std = 0.1f;
   float tau_val = 2.0f;
@@ -66,32 +128,61 @@ private:
   lo_message msg;
   lo_address target;
   std::string path_;
-  float* p_hue = NULL;
-  float* p_sat = NULL;
-  float* p_val = NULL;
   int p_scale;
   int method = 1;
   TASCAR::bandpassf_t bp;
   bool usestd = true;
+  HoS::bandmode_t bandmode;
+  HoS::constq_t* cq = NULL;
+  HoS::gammatone_bank_t* gt = NULL;
+  // pitch class and phasor on the octave circle of each band:
+  std::vector<uint32_t> band_key;
+  std::vector<std::complex<float>> band_cis;
+  // intensities of current frame:
+  std::complex<float> c_mean;
+  float int_total;
 };
 
 pitch2colour_t::pitch2colour_t(const std::string& server_addr,
                                const std::string& server_port,
-                               const std::string& jackname, uint32_t fragsize,
+                               const std::string& jackname, uint32_t hopsize,
+                               uint32_t fftlen, float sendrate_,
                                const std::string& url, const std::string& path,
-                               int p_scale)
-    : jackc_db_t(jackname, fragsize), TASCAR::osc_server_t(server_addr,
-                                                           server_port, "UDP"),
-      ola(4 * fragsize, 2 * fragsize, fragsize, TASCAR::stft_t::WND_HANNING,
-          TASCAR::stft_t::WND_HANNING, 0.5),
-      dtfft(4 * fragsize, 2 * fragsize, fragsize, TASCAR::stft_t::WND_HANNING,
-            0.5),
-      d1(fragsize), ifscale(-srate / TASCAR_PI2),
-      mean_lp(ola.s.n_, srate / (double)fragsize),
-      std_lp(ola.s.n_, srate / (double)fragsize), msg(lo_message_new()),
+                               int p_scale, HoS::bandmode_t bandmode)
+    : jackc_db_t(jackname, hopsize), TASCAR::osc_server_t(server_addr,
+                                                          server_port, "UDP"),
+      frames(64), b_run_sender(false), sendrate(sendrate_),
+      hopsize(hopsize),
+      stft(fftlen, fftlen, hopsize, TASCAR::stft_t::WND_HANNING, 0.5),
+      ifa(fftlen, fftlen, hopsize, srate), msg(lo_message_new()),
       target(lo_address_new_from_url(url.c_str())), path_(path),
-      p_scale(p_scale), bp(100.0f, 4000.0f, srate)
+      p_scale(p_scale), bp(100.0f, 4000.0f, srate), bandmode(bandmode)
 {
+  if(fftlen < hopsize)
+    throw TASCAR::ErrMsg("The FFT length must not be smaller than the hop "
+                         "size.");
+  if(sendrate <= 0.0f)
+    throw TASCAR::ErrMsg("Invalid send rate.");
+  if(bandmode != HoS::BANDS_FFT) {
+    // semitones relative to a, from 100 Hz to 4 kHz:
+    std::vector<float> f(
+        HoS::logfreqs(440.0f * powf(2.0f, -25.0f / 12.0f), 4000.0f, 12.0f));
+    for(auto fc : f) {
+      float octave(log2f(fc / 440.0f));
+      int key(lroundf(12.0f * octave));
+      band_key.push_back(((key % 12) + 12) % 12);
+      band_cis.push_back(std::polar(1.0f, TASCAR_2PIf * octave));
+    }
+    if(bandmode == HoS::BANDS_CONSTQ)
+      cq = new HoS::constq_t(fftlen, srate, f, 12.0f);
+    if(bandmode == HoS::BANDS_GAMMATONE) {
+      // bandwidth of one semitone:
+      std::vector<float> bw;
+      for(auto fc : f)
+        bw.push_back(fc * (powf(2.0f, 1.0f / 12.0f) - 1.0f));
+      gt = new HoS::gammatone_bank_t(f, bw, srate);
+    }
+  }
   set_prefix("/" + jackname + "/");
   add_bool_true("quit", &b_quit);
   add_float("tau", &tau_std);
@@ -104,14 +195,26 @@ pitch2colour_t::pitch2colour_t(const std::string& server_addr,
   lo_message_add_float(msg, 0.0f);
   lo_message_add_float(msg, 1.0f);
   lo_message_add_float(msg, 0.001f);
-  auto argv = lo_message_get_argv(msg);
-  p_hue = &(argv[0]->f);
-  p_sat = &(argv[1]->f);
-  p_val = &(argv[2]->f);
+}
+
+pitch2colour_t::~pitch2colour_t()
+{
+  if(sender.joinable()) {
+    b_run_sender = false;
+    sender.join();
+  }
+  lo_message_free(msg);
+  lo_address_free(target);
+  if(cq)
+    delete cq;
+  if(gt)
+    delete gt;
 }
 
 void pitch2colour_t::activate()
 {
+  b_run_sender = true;
+  sender = std::thread(&pitch2colour_t::send_thread, this);
   jackc_t::activate();
   osc_server_t::activate();
 }
@@ -120,11 +223,111 @@ void pitch2colour_t::deactivate()
 {
   osc_server_t::deactivate();
   jackc_t::deactivate();
+  b_run_sender = false;
+  if(sender.joinable())
+    sender.join();
+}
+
+void pitch2colour_t::send_thread()
+{
+  auto argv = lo_message_get_argv(msg);
+  // average all frames of one send period if hops are shorter:
+  const bool b_mean(hopsize < srate / sendrate);
+  hsv_frame_t cur;
+  hsv_frame_t next;
+  hsv_frame_t out;
+  bool has_next(false);
+  auto period(std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+      std::chrono::duration<double>(1.0 / sendrate)));
+  auto t_next(std::chrono::steady_clock::now());
+  while(b_run_sender) {
+    t_next += period;
+    std::this_thread::sleep_until(t_next);
+    if(b_mean) {
+      // circular mean of hue:
+      float hx(0.0f);
+      float hy(0.0f);
+      float sat(0.0f);
+      float val(0.0f);
+      uint32_t cnt(0);
+      while(frames.pop(next)) {
+        hx += cosf(DEG2RAD * next.hue);
+        hy += sinf(DEG2RAD * next.hue);
+        sat += next.sat;
+        val += next.val;
+        ++cnt;
+      }
+      if(cnt) {
+        out.hue = RAD2DEG * atan2f(hy, hx);
+        if(out.hue < 0.0f)
+          out.hue += 360.0f;
+        out.sat = sat / cnt;
+        out.val = val / cnt;
+      }
+    } else {
+      const jack_nframes_t t_render(jack_frame_time(jc) - hopsize);
+      // advance until the next frame is later than the render time:
+      while(true) {
+        if(!has_next)
+          has_next = frames.pop(next);
+        if(!has_next || ((int32_t)(next.time - t_render) > 0))
+          break;
+        cur = next;
+        has_next = false;
+      }
+      out = cur;
+      if(has_next) {
+        int32_t dt((int32_t)(next.time - cur.time));
+        if(dt > 0) {
+          float w((float)(int32_t)(t_render - cur.time) / dt);
+          out = interpolate(cur, next, std::min(1.0f, std::max(0.0f, w)));
+        }
+      }
+    }
+    argv[0]->f = out.hue;
+    argv[1]->f = out.sat;
+    argv[2]->f = out.val;
+    lo_send_message(target, path_.c_str(), msg);
+  }
+}
+
+/**
+   \brief Add the intensities of FFT bins to the pitch classes, by
+   their instantaneous frequency
+ */
+void pitch2colour_t::fold_bins()
+{
+  float sigma0_corr(0.69315f / sigma0);
+  for(unsigned int k = 0; k < ifa.size(); k++) {
+    float ifreq_mean(ifa.ifmean[k]);
+    float intens = ifa.mag[k];
+    float gain = HoS::fast_expf(-ifa.ifstd[k] * sigma0_corr);
+    if(usestd)
+      intens *= gain;
+    intens *= intens;
+    if((ifreq_mean > 100.0f) && (ifreq_mean < 4000.0f)) {
+      float octave = HoS::fast_log2f(ifreq_mean / 440.0f);
+      // pitch class relative to a, also for negative octaves:
+      int key = floorf(12.0f * octave);
+      key = ((key % 12) + 12) % 12;
+      pitches[key] += intens;
+      c_mean += HoS::fast_cis(TASCAR_2PIf * octave) * intens;
+      int_total += intens;
+    }
+  }
 }
 
-float sqr(float x)
+/**
+   \brief Add the power of semitone bands to the pitch classes
+ */
+void pitch2colour_t::fold_bands(const TASCAR::wave_t& power)
 {
-  return x * x;
+  for(uint32_t k = 0; k < band_key.size(); ++k) {
+    float intens(power.d[k]);
+    pitches[band_key[k]] += intens;
+    c_mean += band_cis[k] * intens;
+    int_total += intens;
+  }
 }
 
 int pitch2colour_t::inner_process(jack_nframes_t n,
@@ -135,37 +338,27 @@ int pitch2colour_t::inner_process(jack_nframes_t n,
     return 1;
   for(auto& p : pitches)
     p = 0.0f;
-  float sigma0_corr(0.69315f / sigma0);
+  c_mean = 0.0f;
+  int_total = 0.0f;
   TASCAR::wave_t w_in(n, inBuf[0]);
   bp.filter(w_in);
-  mean_lp.set_lowpass(tau_std);
-  std_lp.set_lowpass(tau_std);
   val_lp.set_butterworth(1.0f / tau_val, srate / n);
-  d1.process(w_in);
-  ola.process(w_in);
-  dtfft.process(d1);
-  std::complex<float> c_mean = 0.0f;
-  float int_total = 0.0f;
-  for(unsigned int k = 0; k < dtfft.s.n_; k++) {
-    dtfft.s.b[k] *= conj(ola.s.b[k]);
-    float ifreq(std::arg(dtfft.s.b[k]) * ifscale);
-    float ifreq_mean(mean_lp.filter(k, ifreq));
-    float intens = std::abs(dtfft.s.b[k]);
-    float ifreq_diff(ifreq_mean - ifreq);
-    ifreq_diff *= ifreq_diff;
-    float ifreq_std(sqrtf(std::max(0.0f, std_lp.filter(k, ifreq_diff))));
-    float gain = expf(-ifreq_std * sigma0_corr);
-    if(usestd)
-      intens *= gain;
-    intens *= intens;
-    if((ifreq_mean > 100.0f) && (ifreq_mean < 4000.0f)) {
-      float octave = log2f(ifreq_mean / 440.0f);
-      int key = 12.0f * octave;
-      key = key % 12;
-      pitches[key] += intens;
-      c_mean += std::exp(TASCAR_2PIf * i_f * octave) * intens;
-      int_total += intens;
-    }
+  switch(bandmode) {
+  case HoS::BANDS_FFT:
+    ifa.set_tau(tau_std);
+    stft.process(w_in);
+    ifa.process(w_in, stft.s);
+    fold_bins();
+    break;
+  case HoS::BANDS_CONSTQ:
+    stft.process(w_in);
+    cq->process(stft.s);
+    fold_bands(cq->power);
+    break;
+  case HoS::BANDS_GAMMATONE:
+    gt->process(w_in);
+    fold_bands(gt->power);
+    break;
   }
   float i_mean = 0.0f;
   size_t k_max = 0;
@@ -184,23 +377,22 @@ int pitch2colour_t::inner_process(jack_nframes_t n,
   if(phase < 0.0f)
     phase += TASCAR_2PIf;
   float cval = std::abs(c_mean) / (int_total + EPSf);
+  hsv_frame_t frame;
   switch(method) {
   case 1:
-    *p_hue = RAD2DEG * phase;
-    *p_sat = cval;
-    *p_val = std::max(0.0f, std::min(1.0f, val_lp.filter(cval)));
+    frame.hue = RAD2DEG * phase;
+    frame.sat = cval;
+    frame.val = std::max(0.0f, std::min(1.0f, val_lp.filter(cval)));
     break;
   case 0:
-    *p_hue = (k_max * 30 * p_scale) % 360;
-    *p_sat = std::max(0.0f, std::min(1.0f, i_max));
-    *p_val = std::max(0.0f, std::min(1.0f, val_lp.filter(i_max)));
+    frame.hue = (k_max * 30 * p_scale) % 360;
+    frame.sat = std::max(0.0f, std::min(1.0f, i_max));
+    frame.val = std::max(0.0f, std::min(1.0f, val_lp.filter(i_max)));
     break;
-  default:
-    *p_hue = 0.0f;
-    *p_sat = 0.0f;
-    *p_val = 0.0f;
   }
-  lo_send_message(target, path_.c_str(), msg);
+  frame.time = jack_frame_time(jc);
+  // if the sender is too slow, frames are dropped:
+  frames.push(frame);
   return 0;
 }
 
@@ -225,21 +417,27 @@ int main(int argc, char** argv)
   signal(SIGTERM, &sighandler);
   signal(SIGINT, &sighandler);
   std::string jackname("pitch2col");
-  uint32_t periodsize(2048);
+  uint32_t periodsize(256);
+  uint32_t fftlen(4096);
+  float sendrate(44.0f);
   int p_scale(1);
+  HoS::bandmode_t bandmode(HoS::BANDS_FFT);
   std::string serverport("6978");
   std::string serveraddr("");
-  const char* options = "hj:s:m:p:u:t:l:";
+  const char* options = "hj:s:f:r:m:p:u:t:l:a:";
   std::string url("osc.udp://localhost:9877/");
   std::string path("/light/*/hsv");
   struct option long_options[] = {{"help", 0, 0, 'h'},
                                   {"jackname", 1, 0, 'j'},
                                   {"periodsize", 1, 0, 's'},
+                                  {"fftlen", 1, 0, 'f'},
+                                  {"rate", 1, 0, 'r'},
                                   {"multicast", 1, 0, 'm'},
                                   {"url", 1, 0, 'u'},
                                   {"targetpath", 1, 0, 't'},
                                   {"scale", 1, 0, 'l'},
                                   {"port", 1, 0, 'p'},
+                                  {"bands", 1, 0, 'a'},
                                   {0, 0, 0, 0}};
   int opt(0);
   int option_index(0);
@@ -264,16 +462,25 @@ int main(int argc, char** argv)
     case 's':
       periodsize = atoi(optarg);
       break;
+    case 'f':
+      fftlen = atoi(optarg);
+      break;
+    case 'r':
+      sendrate = atof(optarg);
+      break;
     case 'p':
       serverport = optarg;
       break;
     case 'm':
       serveraddr = optarg;
       break;
+    case 'a':
+      bandmode = HoS::parse_bandmode(optarg);
+      break;
     }
   }
-  pitch2colour_t iff(serveraddr, serverport, jackname, periodsize, url, path,
-                     p_scale);
+  pitch2colour_t iff(serveraddr, serverport, jackname, periodsize, fftlen,
+                     sendrate, url, path, p_scale, bandmode);
   iff.activate();
   while(!b_quit) {
     usleep(100000);
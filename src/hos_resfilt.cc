@@ -1,5 +1,6 @@
 #include "hos_defs.h"
-#include <complex.h>
+#include "libhos_random.h"
+#include <getopt.h>
 #include <iostream>
 #include <math.h>
 #include <stdlib.h>
@@ -10,34 +11,48 @@
 #define PI2 6.283185307179586232
 #define PI2INV 0.15915494309189534561
 
+/// Number of channels is padded to a multiple of this:
+#define RESFILT_LANES 4
+/// Samples per chunk of interleaved processing:
+#define RESFILT_CHUNK 64
+
 namespace HoS {
 
+  /**
+     \brief Bank of resonance filters, one for each channel
+
+     Coefficients and states of all channels are stored in separate
+     arrays, and the inner loops run across channels, so that several
+     channels are processed in parallel in the SIMD lanes. The signal
+     is interleaved, with lanes() values per sample.
+  */
   class resfilt_t {
   public:
-    resfilt_t(double fs, double fragsize);
-    void update(double f0, double q);
-    inline double filter(double x)
-    {
-      y0 = (A1 += dA1) * y1 + (A2 += dA2) * y2 + x + (B1 += dB1) * x1 +
-           (B2 += dB2) * x2;
-      y2 = y1;
-      y1 = y0;
-      x2 = x1;
-      x1 = x;
-      return y0;
-    }
+    resfilt_t(uint32_t lanes, double fs, double fragsize);
+    /**
+       \brief Set target coefficients of one channel, reached at the end
+       of the next block
+       \param k Channel index
+       \param f0 Resonance frequency in Hz
+       \param q Pole radius at Nyquist frequency
+    */
+    void update(uint32_t k, double f0, double q);
+    /**
+       \brief Filter interleaved signal in place
+       \param x Signal, n*lanes() values
+       \param n Number of samples
+    */
+    void filter(double* x, uint32_t n);
+    uint32_t lanes() const { return nl; };
 
   private:
-    double y0, y1, y2;
-    double x1, x2;
-    double A1;
-    double A2;
-    double dA1;
-    double dA2;
-    double B1;
-    double B2;
-    double dB1;
-    double dB2;
+    uint32_t nl;
+    std::vector<double> y1, y2;
+    std::vector<double> x1, x2;
+    std::vector<double> A1, A2;
+    std::vector<double> dA1, dA2;
+    std::vector<double> B1, B2;
+    std::vector<double> dB1, dB2;
     double dt;
     double fs_;
   };
@@ -47,7 +62,8 @@ namespace HoS {
   */
   class cyclephase_t : public jackc_t {
   public:
-    cyclephase_t(const std::string& name);
+    cyclephase_t(const std::string& jackname,
+                 const std::vector<std::string>& names);
     ~cyclephase_t();
     void run();
     void quit() { b_quit = true; };
@@ -56,9 +72,13 @@ namespace HoS {
     int process(jack_nframes_t nframes, const std::vector<float*>& inBuffer,
                 const std::vector<float*>& outBuffer);
     bool b_quit;
+    uint32_t nch;
+    uint32_t nl;
     resfilt_t flt_pre;
     resfilt_t flt_post;
-    double rgain, drgain;
+    std::vector<double> rgain, drgain;
+    std::vector<xorshift_t> rng;
+    std::vector<double> buf;
     double f_min, f_max;
   };
 
@@ -66,42 +86,87 @@ namespace HoS {
 
 using namespace HoS;
 
-resfilt_t::resfilt_t(double fs, double fragsize)
-    : y0(0), y1(0), y2(0), x1(0), x2(0), A1(0), A2(0), dA1(0), dA2(0), B1(0),
-      B2(0), dB1(0), dB2(0), dt(1.0 / fragsize), fs_(fs)
+resfilt_t::resfilt_t(uint32_t lanes, double fs, double fragsize)
+    : nl(lanes), y1(nl, 0.0), y2(nl, 0.0), x1(nl, 0.0), x2(nl, 0.0),
+      A1(nl, 0.0), A2(nl, 0.0), dA1(nl, 0.0), dA2(nl, 0.0), B1(nl, 0.0),
+      B2(nl, 0.0), dB1(nl, 0.0), dB2(nl, 0.0), dt(1.0 / fragsize), fs_(fs)
 {
 }
 
-void resfilt_t::update(double f0, double q)
+void resfilt_t::update(uint32_t k, double f0, double q)
 {
   f0 /= fs_;
   f0 *= 2.0;
   double q_pole = pow(q, f0);
   double q_zero = q_pole * q_pole;
-  dA1 = (2.0 * q_pole * cos(M_PI * f0) - A1) * dt;
-  dA2 = (-q_pole * q_pole - A2) * dt;
-  dB1 = (-2.0 * q_zero - B1) * dt;
-  dB2 = (q_zero * q_zero - B2) * dt;
+  dA1[k] = (2.0 * q_pole * cos(M_PI * f0) - A1[k]) * dt;
+  dA2[k] = (-q_pole * q_pole - A2[k]) * dt;
+  dB1[k] = (-2.0 * q_zero - B1[k]) * dt;
+  dB2[k] = (q_zero * q_zero - B2[k]) * dt;
 }
 
-cyclephase_t::cyclephase_t(const std::string& name)
-    : jackc_t(name), b_quit(false), flt_pre(srate, fragsize),
-      flt_post(srate, fragsize), rgain(0.0), drgain(0.0), f_min(100.0),
-      f_max(4000.0)
+/*
+  Biquad recurrence of all lanes. The states and coefficients are
+  passed as separate restrict pointers, otherwise the alias analysis
+  fails and the loop across lanes is not vectorized.
+*/
+static void filter_lanes(double* __restrict__ x, uint32_t n, uint32_t nl,
+                         double* __restrict__ y1, double* __restrict__ y2,
+                         double* __restrict__ x1, double* __restrict__ x2,
+                         double* __restrict__ a1, double* __restrict__ a2,
+                         double* __restrict__ b1, double* __restrict__ b2,
+                         const double* __restrict__ da1,
+                         const double* __restrict__ da2,
+                         const double* __restrict__ db1,
+                         const double* __restrict__ db2)
 {
-  add_input_port("x");
-  add_input_port("f");
-  add_input_port("q");
-  add_output_port("y");
+  for(uint32_t i = 0; i < n; ++i) {
+    double* xi(x + i * nl);
+    for(uint32_t c = 0; c < nl; ++c) {
+      a1[c] += da1[c];
+      a2[c] += da2[c];
+      b1[c] += db1[c];
+      b2[c] += db2[c];
+      double y0(a1[c] * y1[c] + a2[c] * y2[c] + xi[c] + b1[c] * x1[c] +
+                b2[c] * x2[c]);
+      y2[c] = y1[c];
+      y1[c] = y0;
+      x2[c] = x1[c];
+      x1[c] = xi[c];
+      xi[c] = y0;
+    }
+  }
 }
 
-cyclephase_t::~cyclephase_t() {}
+void resfilt_t::filter(double* x, uint32_t n)
+{
+  filter_lanes(x, n, nl, y1.data(), y2.data(), x1.data(), x2.data(),
+               A1.data(), A2.data(), B1.data(), B2.data(), dA1.data(),
+               dA2.data(), dB1.data(), dB2.data());
+}
 
-inline double randd()
+cyclephase_t::cyclephase_t(const std::string& jackname,
+                           const std::vector<std::string>& names)
+    : jackc_t(jackname), b_quit(false), nch(names.size()),
+      nl(RESFILT_LANES * ((nch + RESFILT_LANES - 1) / RESFILT_LANES)),
+      flt_pre(nl, srate, fragsize), flt_post(nl, srate, fragsize),
+      rgain(nl, 0.0), drgain(nl, 0.0), buf(nl * RESFILT_CHUNK, 0.0),
+      f_min(100.0), f_max(4000.0)
 {
-  return (double)rand() / (double)RAND_MAX;
+  for(uint32_t k = 0; k < nl; ++k)
+    rng.push_back(xorshift_t(2463534242u + 7919u * k));
+  for(auto& name : names) {
+    std::string pref((nch > 1) ? (name + ".") : "");
+    add_input_port(pref + "x");
+    add_input_port(pref + "f");
+    add_input_port(pref + "q");
+  }
+  for(auto& name : names)
+    add_output_port((nch > 1) ? (name + ".y") : "y");
 }
 
+cyclephase_t::~cyclephase_t() {}
+
 inline double limit(double x, double xmin, double xmax)
 {
   return std::min(xmax, std::max(xmin, x));
@@ -111,18 +176,39 @@ int cyclephase_t::process(jack_nframes_t nframes,
                           const std::vector<float*>& inBuffer,
                           const std::vector<float*>& outBuffer)
 {
-  float* v_x(inBuffer[0]);
-  float* v_f(inBuffer[1]);
-  float* v_q(inBuffer[2]);
-  float* v_y(outBuffer[0]);
-  flt_pre.update(f_min * pow(f_max / f_min, limit(v_f[0], 0, 1)),
-                 limit(0.5 * v_q[0], 0, 0.99));
-  flt_post.update(f_min * pow(f_max / f_min, limit(v_f[0], 0, 1)),
-                  limit(v_q[0], 0, 0.99));
-  drgain = (v_q[0] - rgain) / nframes;
-  for(jack_nframes_t i = 0; i < nframes; ++i) {
-    v_y[i] = flt_post.filter(flt_pre.filter(v_x[i]) *
-                             (1.0 - (rgain += drgain) * randd()));
+  for(uint32_t k = 0; k < nch; ++k) {
+    float v_f(inBuffer[3 * k + 1][0]);
+    float v_q(inBuffer[3 * k + 2][0]);
+    double f0(f_min * pow(f_max / f_min, limit(v_f, 0, 1)));
+    flt_pre.update(k, f0, limit(0.5 * v_q, 0, 0.99));
+    flt_post.update(k, f0, limit(v_q, 0, 0.99));
+    drgain[k] = (v_q - rgain[k]) / nframes;
+  }
+  double* __restrict__ rg(rgain.data());
+  const double* __restrict__ drg(drgain.data());
+  xorshift_t* __restrict__ r(rng.data());
+  for(uint32_t i0 = 0; i0 < nframes; i0 += RESFILT_CHUNK) {
+    uint32_t n(std::min((uint32_t)RESFILT_CHUNK, nframes - i0));
+    for(uint32_t k = 0; k < nch; ++k) {
+      const float* v_x(inBuffer[3 * k] + i0);
+      for(uint32_t i = 0; i < n; ++i)
+        buf[i * nl + k] = v_x[i];
+    }
+    flt_pre.filter(buf.data(), n);
+    // random gain modulation, uniform noise in (0,1]:
+    for(uint32_t i = 0; i < n; ++i) {
+      double* __restrict__ xi(&(buf[i * nl]));
+      for(uint32_t c = 0; c < nl; ++c) {
+        rg[c] += drg[c];
+        xi[c] *= 1.0 - rg[c] * (2.3283064370807974e-10 * r[c]());
+      }
+    }
+    flt_post.filter(buf.data(), n);
+    for(uint32_t k = 0; k < nch; ++k) {
+      float* v_y(outBuffer[k] + i0);
+      for(uint32_t i = 0; i < n; ++i)
+        v_y[i] = buf[i * nl + k];
+    }
   }
   return 0;
 }
@@ -130,23 +216,54 @@ int cyclephase_t::process(jack_nframes_t nframes,
 void cyclephase_t::run()
 {
   jackc_t::activate();
-  // connect_in(0,"japa:pink",true);
-  // connect_in(1,"osc2jack:/f",true);
-  // connect_in(2,"osc2jack:/q",true);
-  // connect_out(0,"japa:in_1",true);
   while(!b_quit) {
     sleep(1);
   }
   jackc_t::deactivate();
 }
 
+void usage(struct option* opt)
+{
+  std::cout << "Usage:\n\nhos_resfilt [options] [name ...]\n\n"
+               "Each name creates one filter channel, with the ports "
+               "name.x, name.f, name.q\nand name.y. With a single name, the "
+               "ports are x, f, q and y.\n\nOptions:\n\n";
+  while(opt->name) {
+    std::cout << "  -" << (char)(opt->val) << " " << (opt->has_arg ? "#" : "")
+              << "\n  --" << opt->name << (opt->has_arg ? "=#" : "") << "\n\n";
+    opt++;
+  }
+}
+
 int main(int argc, char** argv)
 {
-  std::string name("resflt");
-  if(argc > 1)
-    name = argv[1];
-  cyclephase_t S(name);
+  std::string jackname;
+  std::vector<std::string> names;
+  const char* options = "hj:";
+  struct option long_options[] = {
+      {"help", 0, 0, 'h'}, {"jackname", 1, 0, 'j'}, {0, 0, 0, 0}};
+  int opt(0);
+  int option_index(0);
+  while((opt = getopt_long(argc, argv, options, long_options, &option_index)) !=
+        -1) {
+    switch(opt) {
+    case 'h':
+      usage(long_options);
+      return -1;
+    case 'j':
+      jackname = optarg;
+      break;
+    }
+  }
+  while(optind < argc)
+    names.push_back(argv[optind++]);
+  if(names.empty())
+    names.push_back("resflt");
+  if(jackname.empty())
+    jackname = (names.size() > 1) ? "resflt" : names[0];
+  cyclephase_t S(jackname, names);
   S.run();
+  return 0;
 }
 
 /*
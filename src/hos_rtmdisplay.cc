@@ -5,6 +5,8 @@
 
 #include "hos_defs.h"
 #include "libhos_music.h"
+#include "spscqueue.h"
+#include <atomic>
 #include <cairomm/context.h>
 #include <gtkmm.h>
 #include <gtkmm/drawingarea.h>
@@ -43,12 +45,210 @@ std::string text(uint32_t n)
   return ctmp;
 }
 
+/**
+   \brief Time-ordered ring buffer
+
+   Elements are indexed by time. Since events arrive nearly in temporal
+   order and old events are discarded, elements are typically appended
+   at the end and removed from the beginning, both without memory
+   allocation. Lookup by time uses binary search. Index 0 is the
+   oldest element.
+
+   \ingroup rtm
+ */
+template <class T> class time_ring_t {
+public:
+  time_ring_t(uint32_t capacity = 256);
+  uint32_t size() const { return n; };
+  bool empty() const { return n == 0; };
+  double time(uint32_t k) const { return times[idx(k)]; };
+  T& operator[](uint32_t k) { return data[idx(k)]; };
+  const T& operator[](uint32_t k) const { return data[idx(k)]; };
+  uint32_t lower_bound(double t) const;
+  uint32_t upper_bound(double t) const;
+  uint32_t find(double t) const;
+  T& insert(double t);
+  void pop_front();
+  void clear();
+
+private:
+  uint32_t idx(uint32_t k) const { return (start + k) & mask; };
+  void grow();
+  std::vector<double> times;
+  std::vector<T> data;
+  uint32_t start;
+  uint32_t n;
+  uint32_t mask;
+};
+
+/**
+   \param capacity Initial capacity, rounded up to a power of two
+ */
+template <class T>
+time_ring_t<T>::time_ring_t(uint32_t capacity) : start(0), n(0), mask(0)
+{
+  uint32_t cap(1);
+  while(cap < capacity)
+    cap <<= 1;
+  times.resize(cap);
+  data.resize(cap);
+  mask = cap - 1;
+}
+
+/**
+   \brief Return index of first element not earlier than t, or size()
+ */
+template <class T> uint32_t time_ring_t<T>::lower_bound(double t) const
+{
+  uint32_t k0(0);
+  uint32_t k1(n);
+  while(k0 < k1) {
+    uint32_t k((k0 + k1) / 2);
+    if(time(k) < t)
+      k0 = k + 1;
+    else
+      k1 = k;
+  }
+  return k0;
+}
+
+/**
+   \brief Return index of first element later than t, or size()
+ */
+template <class T> uint32_t time_ring_t<T>::upper_bound(double t) const
+{
+  uint32_t k0(0);
+  uint32_t k1(n);
+  while(k0 < k1) {
+    uint32_t k((k0 + k1) / 2);
+    if(time(k) <= t)
+      k0 = k + 1;
+    else
+      k1 = k;
+  }
+  return k0;
+}
+
+/**
+   \brief Return index of element at time t, or size() if not found
+ */
+template <class T> uint32_t time_ring_t<T>::find(double t) const
+{
+  // most lookups are for the newest element:
+  if(n && (time(n - 1) == t))
+    return n - 1;
+  uint32_t k(lower_bound(t));
+  if((k < n) && (time(k) == t))
+    return k;
+  return n;
+}
+
+/**
+   \brief Return element at time t, create a new one if not existing
+ */
+template <class T> T& time_ring_t<T>::insert(double t)
+{
+  uint32_t k(n);
+  if(n && (time(n - 1) >= t)) {
+    k = lower_bound(t);
+    if(time(k) == t)
+      return data[idx(k)];
+  }
+  if(n == times.size())
+    grow();
+  // move later elements, if any, to make space for the new element:
+  for(uint32_t km = n; km > k; --km) {
+    times[idx(km)] = times[idx(km - 1)];
+    data[idx(km)] = data[idx(km - 1)];
+  }
+  ++n;
+  times[idx(k)] = t;
+  data[idx(k)] = T();
+  return data[idx(k)];
+}
+
+/**
+   \brief Remove oldest element
+ */
+template <class T> void time_ring_t<T>::pop_front()
+{
+  if(n) {
+    data[start] = T();
+    start = idx(1);
+    --n;
+  }
+}
+
+template <class T> void time_ring_t<T>::clear()
+{
+  while(n)
+    pop_front();
+  start = 0;
+}
+
+/**
+   \brief Double capacity
+ */
+template <class T> void time_ring_t<T>::grow()
+{
+  std::vector<double> ntimes(2 * times.size());
+  std::vector<T> ndata(2 * times.size());
+  for(uint32_t k = 0; k < n; ++k) {
+    ntimes[k] = time(k);
+    ndata[k] = data[idx(k)];
+  }
+  times.swap(ntimes);
+  data.swap(ndata);
+  start = 0;
+  mask = times.size() - 1;
+}
+
 void clef_t::draw_full(Cairo::RefPtr<Cairo::Context> cr, double x, double y)
 {
   cr->move_to(x, -(y + position));
   cr->show_text(symbol);
 }
 
+/**
+   \brief Cache of glyph extents
+
+   Text extents are measured once per symbol on a private Cairo
+   context, using the same font as the score, so that the layout can
+   be computed without access to the drawing context.
+
+   \ingroup rtm
+ */
+class glyph_metrics_t {
+public:
+  glyph_metrics_t();
+  const Cairo::TextExtents& extents(const std::string& symbol);
+
+private:
+  Cairo::RefPtr<Cairo::ImageSurface> surface;
+  Cairo::RefPtr<Cairo::Context> cr;
+  std::map<std::string, Cairo::TextExtents> cache;
+};
+
+glyph_metrics_t::glyph_metrics_t()
+    : surface(Cairo::ImageSurface::create(Cairo::FORMAT_A8, 1, 1)),
+      cr(Cairo::Context::create(surface))
+{
+  cr->select_font_face("Emmentaler-16", Cairo::FONT_SLANT_NORMAL,
+                       Cairo::FONT_WEIGHT_NORMAL);
+  cr->set_font_size(8);
+}
+
+const Cairo::TextExtents& glyph_metrics_t::extents(const std::string& symbol)
+{
+  std::map<std::string, Cairo::TextExtents>::iterator it(cache.find(symbol));
+  if(it == cache.end()) {
+    Cairo::TextExtents ext;
+    cr->get_text_extents(symbol, ext);
+    it = cache.insert(std::make_pair(symbol, ext)).first;
+  }
+  return it->second;
+}
+
 /**
    \ingroup rtm
  */
@@ -89,21 +289,29 @@ public:
     o << "y=" << p.y << " (" << p.alteration << ")";
     return o;
   };
-  void draw(Cairo::RefPtr<Cairo::Context> cr, double x, double y_0);
-  double xmin(Cairo::RefPtr<Cairo::Context> cr);
-  double xmax(Cairo::RefPtr<Cairo::Context> cr);
+  void layout(glyph_metrics_t& metrics);
+  void draw(Cairo::RefPtr<Cairo::Context> cr, double x, double y_0) const;
+  double xmin() const { return x_min; };
+  double xmax() const { return x_max; };
 
 private:
   std::string sym_head;
   std::string sym_alteration;
   std::string sym_flag;
+  Cairo::TextExtents head; ///< Extents of note head symbol
+  double x_min;            ///< Left extension relative to note position
+  double x_max;            ///< Right extension relative to note position
 };
 
-graphical_note_t::graphical_note_t() : y(0), alteration(0) {}
+graphical_note_t::graphical_note_t()
+    : y(0), alteration(0), head(), x_min(0), x_max(0)
+{
+}
 
 graphical_note_t::graphical_note_t(const note_t& note, const clef_t& clef,
                                    int key, const graphical_note_t& prev)
-    : note_t(note), sym_head(Symbols::notehead[checklen(length) / 2])
+    : note_t(note), sym_head(Symbols::notehead[checklen(length) / 2]),
+      head(), x_min(0), x_max(0)
 {
   if(pitch != PITCH_REST) {
     int octave(floor((double)pitch / 12.0));
@@ -154,37 +362,29 @@ graphical_note_t::graphical_note_t(const note_t& note, const clef_t& clef,
   }
 }
 
-double graphical_note_t::xmin(Cairo::RefPtr<Cairo::Context> cr)
+/**
+   \brief Compute graphical extension of the note from cached glyph metrics
+ */
+void graphical_note_t::layout(glyph_metrics_t& metrics)
 {
-  Cairo::TextExtents extents;
-  cr->get_text_extents(sym_head, extents);
-  double x(extents.x_bearing);
+  head = metrics.extents(sym_head);
+  x_min = head.x_bearing;
   if(sym_alteration.size())
-    x -= 2.4;
-  return x;
-}
-
-double graphical_note_t::xmax(Cairo::RefPtr<Cairo::Context> cr)
-{
-  Cairo::TextExtents extents;
-  cr->get_text_extents(sym_head, extents);
-  double x(extents.width + extents.x_bearing);
-  double x0(extents.x_bearing);
+    x_min -= 2.4;
+  x_max = head.width + head.x_bearing;
   if(sym_flag.size()) {
-    cr->get_text_extents(sym_flag, extents);
+    const Cairo::TextExtents& flag(metrics.extents(sym_flag));
     if(y > 0)
-      x = std::max(x, x0 + extents.x_bearing + extents.width);
+      x_max = std::max(x_max, head.x_bearing + flag.x_bearing + flag.width);
     else
-      x += extents.x_bearing + extents.width;
+      x_max += flag.x_bearing + flag.width;
   }
-  return x;
 }
 
 void graphical_note_t::draw(Cairo::RefPtr<Cairo::Context> cr, double x,
-                            double y_0)
+                            double y_0) const
 {
-  Cairo::TextExtents extents;
-  cr->get_text_extents(sym_head, extents);
+  const Cairo::TextExtents& extents(head);
   // draw head:
   cr->move_to(x, -(y_0 + y));
   cr->show_text(sym_head);
@@ -247,9 +447,9 @@ public:
   // void draw_keychange(Cairo::RefPtr<Cairo::Context> cr,int oldkey,int
   // newkey,double y);
   void draw_music(Cairo::RefPtr<Cairo::Context> cr, double time, double x);
-  double left_space(Cairo::RefPtr<Cairo::Context> cr, double time);
-  double right_space(Cairo::RefPtr<Cairo::Context> cr, double time);
-  void add_note(note_t n, int32_t fifths);
+  double left_space(double time);
+  double right_space(double time);
+  void add_note(note_t n, int32_t fifths, glyph_metrics_t& metrics);
   void clear_music(double t0);
   void clear_all();
 
@@ -261,7 +461,7 @@ public:
   double y_0;
 
 private:
-  std::map<double, graphical_note_t> notes;
+  time_ring_t<graphical_note_t> notes;
 };
 
 staff_t::staff_t()
@@ -273,24 +473,24 @@ staff_t::staff_t()
 void staff_t::draw_music(Cairo::RefPtr<Cairo::Context> cr, double time,
                          double x)
 {
-  std::map<double, graphical_note_t>::iterator note(notes.find(time));
-  if(note != notes.end())
-    note->second.draw(cr, x, y_0);
+  uint32_t note(notes.find(time));
+  if(note < notes.size())
+    notes[note].draw(cr, x, y_0);
 }
 
-double staff_t::left_space(Cairo::RefPtr<Cairo::Context> cr, double time)
+double staff_t::left_space(double time)
 {
-  std::map<double, graphical_note_t>::iterator note(notes.find(time));
-  if(note != notes.end())
-    return -note->second.xmin(cr);
+  uint32_t note(notes.find(time));
+  if(note < notes.size())
+    return -notes[note].xmin();
   return 0;
 }
 
-double staff_t::right_space(Cairo::RefPtr<Cairo::Context> cr, double time)
+double staff_t::right_space(double time)
 {
-  std::map<double, graphical_note_t>::iterator note(notes.find(time));
-  if(note != notes.end())
-    return note->second.xmax(cr);
+  uint32_t note(notes.find(time));
+  if(note < notes.size())
+    return notes[note].xmax();
   return 0;
 }
 
@@ -301,18 +501,19 @@ void staff_t::clear_all()
 
 void staff_t::clear_music(double t0)
 {
-  while(notes.size() && (notes.begin()->first < t0))
-    notes.erase(notes.begin());
+  while(notes.size() && (notes.time(0) < t0))
+    notes.pop_front();
 }
 
-void staff_t::add_note(note_t n, int32_t fifths)
+void staff_t::add_note(note_t n, int32_t fifths, glyph_metrics_t& metrics)
 {
-  notes[n.time] = graphical_note_t(n, clef, fifths);
-  std::map<double, graphical_note_t>::iterator prev = notes.find(n.time);
-  if(prev != notes.begin()) {
-    prev--;
-    notes[n.time] = graphical_note_t(n, clef, fifths, prev->second);
-  }
+  graphical_note_t& note(notes.insert(n.time));
+  uint32_t prev(notes.find(n.time));
+  if(prev > 0)
+    note = graphical_note_t(n, clef, fifths, notes[prev - 1]);
+  else
+    note = graphical_note_t(n, clef, fifths);
+  note.layout(metrics);
 }
 
 // void staff_t::draw_keychange(Cairo::RefPtr<Cairo::Context> cr,int oldkey,int
@@ -342,18 +543,20 @@ public:
   graphical_time_signature_t();
   graphical_time_signature_t(double nom, double denom, double startt,
                              uint32_t addb);
-  void draw(Cairo::RefPtr<Cairo::Context> cr, double x, double y);
-  double space(Cairo::RefPtr<Cairo::Context> cr);
+  void layout(glyph_metrics_t& metrics);
+  void draw(Cairo::RefPtr<Cairo::Context> cr, double x, double y) const;
+  double space() const { return xspace; };
 
 private:
   std::string s_denom;
   std::string s_nom;
   double l_denom;
   double l_nom;
+  double xspace;
 };
 
 graphical_time_signature_t::graphical_time_signature_t()
-    : time_signature_t(), l_denom(0), l_nom(0)
+    : time_signature_t(), l_denom(0), l_nom(0), xspace(0)
 {
 }
 
@@ -361,14 +564,14 @@ graphical_time_signature_t::graphical_time_signature_t(double nom, double denom,
                                                        double startt,
                                                        uint32_t addb)
     : time_signature_t(nom, denom, startt, addb), s_denom(text(denom)),
-      s_nom(text(nom)), l_denom(0), l_nom(0)
+      s_nom(text(nom)), l_denom(0), l_nom(0), xspace(0)
 {
 }
 
 void graphical_time_signature_t::draw(Cairo::RefPtr<Cairo::Context> cr,
-                                      double x, double y)
+                                      double x, double y) const
 {
-  double xl(space(cr));
+  double xl(xspace);
   //+0.5*(l_nom-std::min(l_nom,l_denom))
   cr->move_to(x - xl + 0.5 * (l_denom - std::min(l_nom, l_denom)), -y);
   cr->show_text(text(numerator));
@@ -376,16 +579,50 @@ void graphical_time_signature_t::draw(Cairo::RefPtr<Cairo::Context> cr,
   cr->show_text(text(denominator));
 }
 
-double graphical_time_signature_t::space(Cairo::RefPtr<Cairo::Context> cr)
+void graphical_time_signature_t::layout(glyph_metrics_t& metrics)
 {
-  Cairo::TextExtents extents;
-  cr->get_text_extents(s_denom, extents);
-  l_denom = extents.x_bearing + extents.width;
-  cr->get_text_extents(s_nom, extents);
-  l_nom = extents.x_bearing + extents.width;
-  return std::max(l_denom, l_nom) + 1;
+  const Cairo::TextExtents& ext_denom(metrics.extents(s_denom));
+  l_denom = ext_denom.x_bearing + ext_denom.width;
+  const Cairo::TextExtents& ext_nom(metrics.extents(s_nom));
+  l_nom = ext_nom.x_bearing + ext_nom.width;
+  xspace = std::max(l_denom, l_nom) + 1;
 }
 
+/**
+   \brief Horizontal layout of one time position of the score
+
+   Positions are absolute layout coordinates, which do not change
+   when old music is removed; scrolling is done by a translation when
+   drawing.
+
+   \ingroup rtm
+ */
+class xposition_t {
+public:
+  xposition_t() : x(0), xnote(0), xend(0){};
+  double x;     ///< Left edge, including a time signature
+  double xnote; ///< Position of the notes
+  double xend;  ///< Right edge of the widest note
+};
+
+/**
+   \brief Score event, passed from the OSC thread to the GUI thread
+   \ingroup rtm
+ */
+class score_event_t {
+public:
+  enum type_t { settime, addnote, addbeat, clear, settimesig, setkeysig };
+  score_event_t()
+      : type(settime), time(0), i0(0), i1(0), i2(0), f0(0), f1(0){};
+  type_t type;
+  double time; ///< Event time
+  int32_t i0;  ///< Voice, numerator or key pitch
+  int32_t i1;  ///< Pitch, denominator or key mode
+  int32_t i2;  ///< Note length
+  double f0;   ///< Beat
+  double f1;   ///< Beat duration
+};
+
 /**
    \ingroup rtm
  */
@@ -412,36 +649,55 @@ public:
   void add_note(unsigned int voice, int pitch, unsigned int length,
                 double time);
   void draw(Cairo::RefPtr<Cairo::Context> cr);
+  void draw_music(Cairo::RefPtr<Cairo::Context> cr, double x0, double x1,
+                  double t_first, double t_last);
   double get_xpos(double time);
   void set_time_signature(uint32_t numerator, uint32_t deominator,
                           double starttime);
   double bar(double time);
   void set_keysig(double time, int32_t pitch, keysig_t::mode_t mode);
+  void update_layout(double time);
+  void set_tile_geometry(double scale, int height);
+  void post(const score_event_t& ev);
+  void process_events();
 
 protected:
+  void clear_tiles();
+  Cairo::RefPtr<Cairo::ImageSurface> render_tile(int32_t strip,
+                                                 double t_first,
+                                                 double t_last);
   // Override default signal handler:
   virtual bool on_draw(const Cairo::RefPtr<Cairo::Context>& cr);
   bool on_timeout();
   uint32_t numstaves_;
   std::vector<staff_t> staves;
-  std::map<double, double> xpositions;
+  time_ring_t<xposition_t> xpositions;
   double timescale;
   double history;
   double time;
   double x_left;
-  double prev_tpos;
-  double xshift;
-  std::map<double, graphical_time_signature_t> timesig;
-  std::map<double, keysig_t> keysig;
-  pthread_mutex_t mutex;
+  double xshift;      ///< Scroll offset of layout coordinates
+  bool b_snap_scroll; ///< Jump to scroll target instead of smooth scrolling
+  time_ring_t<graphical_time_signature_t> timesig;
+  time_ring_t<keysig_t> keysig;
+  glyph_metrics_t metrics;
+  /// Rendered strips of completed music, indexed by strip number:
+  std::map<int32_t, Cairo::RefPtr<Cairo::ImageSurface>> tiles;
+  std::vector<Cairo::RefPtr<Cairo::ImageSurface>> tile_pool;
+  double tile_width;  ///< Width of one strip in layout coordinates
+  double tile_scale;  ///< Device pixels per layout unit
+  int tile_height;    ///< Height of tiles in device pixels
+  bool b_clear_tiles; ///< Layout was reset, tiles are invalid
+  /// Events from the OSC thread, processed in the GUI thread:
+  HoS::spsc_queue_t<score_event_t> events;
+  std::atomic<uint32_t> lost_events;
+  uint32_t reported_lost_events;
   // std::ofstream debugfile;
 };
 
 void score_t::set_keysig(double time, int32_t pitch, keysig_t::mode_t mode)
 {
-  pthread_mutex_lock(&mutex);
-  keysig[time] = keysig_t(pitch, mode);
-  pthread_mutex_unlock(&mutex);
+  keysig.insert(time) = keysig_t(pitch, mode);
 }
 
 double score_t::bar(double time)
@@ -450,105 +706,218 @@ double score_t::bar(double time)
   if(timesig.empty())
     return 0;
   // find next time signature which is after given time:
-  std::map<double, graphical_time_signature_t>::iterator ts(
-      timesig.lower_bound(time));
+  uint32_t ts(timesig.lower_bound(time));
   // if time signature is not the first one decrease by one to find
   // current time signature:
-  if(ts != timesig.begin())
+  if(ts > 0)
     ts--;
   // return bar number of appropriate time signature:
-  return ts->second.bar(time);
+  return timesig[ts].bar(time);
 }
 
+/**
+   \brief Return left edge of a time position in layout coordinates
+ */
 double score_t::get_xpos(double time)
 {
   if(time < 0.0)
     time = 0.0;
   if(xpositions.empty())
     return 0;
-  std::map<double, double>::const_iterator xp1(xpositions.lower_bound(time));
-  if(xp1 == xpositions.end()) {
+  uint32_t xp1(xpositions.lower_bound(time));
+  if(xp1 == xpositions.size()) {
     // time is larger than all stored positions, extrapolate:
     xp1--;
-    return xp1->second + (time - xp1->first) * timescale;
+    return xpositions[xp1].x + (time - xpositions.time(xp1)) * timescale;
   }
-  if(xp1->first == time)
+  if(xpositions.time(xp1) == time)
     // exact match, return second:
-    return xp1->second;
-  if(xp1 == xpositions.begin()) {
+    return xpositions[xp1].x;
+  if(xp1 == 0) {
     // time is less than all stored positions, extrapolate:
-    return std::max(0.0, xp1->second + (time - xp1->first) * timescale);
+    return xpositions[xp1].x;
   }
   // interpolate:
-  // return xp1->second + xshift;
-  std::map<double, double>::const_iterator xp0(xp1);
-  xp0--;
-  return (time - xp0->first) / (xp1->first - xp0->first) *
-             (xp1->second - xp0->second) +
-         xp0->second;
+  uint32_t xp0(xp1 - 1);
+  return (time - xpositions.time(xp0)) /
+             (xpositions.time(xp1) - xpositions.time(xp0)) *
+             (xpositions[xp1].x - xpositions[xp0].x) +
+         xpositions[xp0].x;
+}
+
+/**
+   \brief Update layout of all time positions from given time on
+
+   Called whenever music was added. Since events typically arrive in
+   temporal order, only the last few positions need to be updated.
+ */
+void score_t::update_layout(double time)
+{
+  for(uint32_t k = xpositions.find(time); k < xpositions.size(); ++k) {
+    double t(xpositions.time(k));
+    xposition_t& xp(xpositions[k]);
+    double lspace(0);
+    double rspace(0);
+    double tsspace(0);
+    // get graphical extension of music and non-music:
+    uint32_t ts(timesig.find(t));
+    if(ts < timesig.size())
+      tsspace = timesig[ts].space();
+    for(std::vector<staff_t>::iterator staff = staves.begin();
+        staff != staves.end(); ++staff) {
+      lspace = std::max(lspace, staff->left_space(t));
+      rspace = std::max(rspace, staff->right_space(t));
+    }
+    double width(tsspace + lspace);
+    if(k > 0) {
+      xp.x = xpositions[k - 1].xend + (t - xpositions.time(k - 1)) * timescale;
+    } else {
+      if(k + 1 < xpositions.size())
+        xp.x = xpositions[k + 1].x - width - rspace -
+               (xpositions.time(k + 1) - t) * timescale;
+      else
+        xp.x = 0;
+    }
+    xp.xnote = xp.x + width;
+    xp.xend = xp.xnote + rspace;
+  }
 }
 
 int score_t::set_keysig(const char* path, const char* types, lo_arg** argv,
                         int argc, lo_message msg, void* user_data)
 {
-  if(user_data && (argc == 3))
-    ((score_t*)user_data)
-        ->set_keysig(argv[0]->f, argv[1]->i, (keysig_t::mode_t)(argv[2]->i));
+  if(user_data && (argc == 3)) {
+    score_event_t ev;
+    ev.type = score_event_t::setkeysig;
+    ev.time = argv[0]->f;
+    ev.i0 = argv[1]->i;
+    ev.i1 = argv[2]->i;
+    ((score_t*)user_data)->post(ev);
+  }
   return 0;
 }
 
 int score_t::set_time(const char* path, const char* types, lo_arg** argv,
                       int argc, lo_message msg, void* user_data)
 {
-  if(user_data && (argc == 1) && (types[0] == 'f'))
-    ((score_t*)user_data)->set_time(argv[0]->f);
+  if(user_data && (argc == 1) && (types[0] == 'f')) {
+    score_event_t ev;
+    ev.type = score_event_t::settime;
+    ev.time = argv[0]->f;
+    ((score_t*)user_data)->post(ev);
+  }
   return 0;
 }
 
 int score_t::set_timesig(const char* path, const char* types, lo_arg** argv,
                          int argc, lo_message msg, void* user_data)
 {
-  if(user_data && (argc == 3))
-    ((score_t*)user_data)
-        ->set_time_signature(argv[1]->i, argv[2]->i, argv[0]->f);
+  if(user_data && (argc == 3)) {
+    score_event_t ev;
+    ev.type = score_event_t::settimesig;
+    ev.time = argv[0]->f;
+    ev.i0 = argv[1]->i;
+    ev.i1 = argv[2]->i;
+    ((score_t*)user_data)->post(ev);
+  }
   return 0;
 }
 
 int score_t::add_note(const char* path, const char* types, lo_arg** argv,
                       int argc, lo_message msg, void* user_data)
 {
-  if(user_data && (argc == 4))
-    ((score_t*)user_data)
-        ->add_note(argv[0]->i, argv[1]->i, argv[2]->i, argv[3]->f);
+  if(user_data && (argc == 4)) {
+    score_event_t ev;
+    ev.type = score_event_t::addnote;
+    ev.i0 = argv[0]->i;
+    ev.i1 = argv[1]->i;
+    ev.i2 = argv[2]->i;
+    ev.time = argv[3]->f;
+    ((score_t*)user_data)->post(ev);
+  }
   return 0;
 }
 
 int score_t::add_beat(const char* path, const char* types, lo_arg** argv,
                       int argc, lo_message msg, void* user_data)
 {
-  if(user_data && (argc == 3))
-    ((score_t*)user_data)->add_beat(argv[0]->f, argv[1]->f, argv[2]->f);
+  if(user_data && (argc == 3)) {
+    score_event_t ev;
+    ev.type = score_event_t::addbeat;
+    ev.time = argv[0]->f;
+    ev.f0 = argv[1]->f;
+    ev.f1 = argv[2]->f;
+    ((score_t*)user_data)->post(ev);
+  }
   return 0;
 }
 
 int score_t::clear_all(const char* path, const char* types, lo_arg** argv,
                        int argc, lo_message msg, void* user_data)
 {
-  if(user_data)
-    ((score_t*)user_data)->clear_all();
+  if(user_data) {
+    score_event_t ev;
+    ev.type = score_event_t::clear;
+    ((score_t*)user_data)->post(ev);
+  }
   return 0;
 }
 
+/**
+   \brief Pass an event to the GUI thread
+
+   Called from the OSC thread; never blocks. Events are dropped if the
+   queue is full.
+ */
+void score_t::post(const score_event_t& ev)
+{
+  if(!events.push(ev))
+    ++lost_events;
+}
+
+/**
+   \brief Apply all pending events to the score (GUI thread only)
+ */
+void score_t::process_events()
+{
+  score_event_t ev;
+  while(events.pop(ev)) {
+    switch(ev.type) {
+    case score_event_t::settime:
+      set_time(ev.time);
+      break;
+    case score_event_t::addnote:
+      add_note(ev.i0, ev.i1, ev.i2, ev.time);
+      break;
+    case score_event_t::addbeat:
+      add_beat(ev.time, ev.f0, ev.f1);
+      break;
+    case score_event_t::clear:
+      clear_all();
+      break;
+    case score_event_t::settimesig:
+      set_time_signature(ev.i0, ev.i1, ev.time);
+      break;
+    case score_event_t::setkeysig:
+      set_keysig(ev.time, ev.i0, (keysig_t::mode_t)ev.i1);
+      break;
+    }
+  }
+  uint32_t lost(lost_events.load());
+  if(lost != reported_lost_events) {
+    std::cerr << "Warning: " << lost - reported_lost_events
+              << " score events were lost.\n";
+    reported_lost_events = lost;
+  }
+}
+
 void score_t::set_time(double t)
 {
-  pthread_mutex_lock(&mutex);
   time = t;
-  pthread_mutex_unlock(&mutex);
 }
 
 void score_t::clear_all()
 {
-  pthread_mutex_lock(&mutex);
   for(std::vector<staff_t>::iterator staff = staves.begin();
       staff != staves.end(); ++staff)
     staff->clear_all();
@@ -556,21 +925,19 @@ void score_t::clear_all()
   timesig.clear();
   keysig.clear();
   xshift = 0;
-  prev_tpos = -history;
-  pthread_mutex_unlock(&mutex);
+  b_snap_scroll = true;
+  b_clear_tiles = true;
 }
 
 void score_t::add_beat(double time, double beat, double dur)
 {
-  pthread_mutex_lock(&mutex);
-  xpositions[time] = dur * timescale;
-  pthread_mutex_unlock(&mutex);
+  xpositions.insert(time);
+  update_layout(time);
 }
 
 void score_t::add_note(unsigned int voice, int pitch, unsigned int length,
                        double time)
 {
-  pthread_mutex_lock(&mutex);
   if(voice < staves.size()) {
     note_t n;
     n.pitch = pitch;
@@ -578,44 +945,41 @@ void score_t::add_note(unsigned int voice, int pitch, unsigned int length,
     n.time = time;
     int fifths(0);
     if(!keysig.empty()) {
-      std::map<double, keysig_t>::iterator ks(keysig.upper_bound(time));
-      if(ks != keysig.begin())
+      uint32_t ks(keysig.upper_bound(time));
+      if(ks > 0)
         ks--;
-      fifths = ks->second.fifths;
+      fifths = keysig[ks].fifths;
     }
-    staves[voice].add_note(n, fifths);
-    // get maximum x-position:
-    double xmax(0);
-    xmax = n.duration() * timescale;
-    xpositions[time] = xmax;
+    staves[voice].add_note(n, fifths, metrics);
+    xpositions.insert(time);
+    update_layout(time);
   }
-  pthread_mutex_unlock(&mutex);
 }
 
 void score_t::set_time_signature(uint32_t numerator, uint32_t denominator,
                                  double starttime)
 {
-  pthread_mutex_lock(&mutex);
-  timesig[starttime] =
-      graphical_time_signature_t(numerator, denominator, starttime, 0);
-  std::map<double, graphical_time_signature_t>::iterator ts(
-      timesig.find(starttime));
+  graphical_time_signature_t& newts(timesig.insert(starttime));
+  newts = graphical_time_signature_t(numerator, denominator, starttime, 0);
+  newts.layout(metrics);
+  uint32_t ts(timesig.find(starttime));
   // if time signature is not the first one decrease by one to find
   // current time signature:
-  if(ts != timesig.begin())
+  if(ts > 0)
     ts--;
-  timesig[starttime].addbar = ts->second.bar(starttime);
-  xpositions[starttime] = 0;
-  pthread_mutex_unlock(&mutex);
+  newts.addbar = timesig[ts].bar(starttime);
+  xpositions.insert(starttime);
+  update_layout(starttime);
 }
 
 score_t::score_t(const std::string& srvaddr, const std::string& srvport,
                  uint32_t numstaves)
     : TASCAR::osc_server_t(srvaddr, srvport, "UDP"), numstaves_(numstaves),
-      timescale(15), history(6), time(0), x_left(-105), prev_tpos(0),
-      xshift(0) //, debugfile("rtmdisplaydebug")
+      timescale(15), history(6), time(0), x_left(-105), xshift(0),
+      b_snap_scroll(true), tile_width(32), tile_scale(0), tile_height(0),
+      b_clear_tiles(false), events(1024), lost_events(0),
+      reported_lost_events(0) //, debugfile("rtmdisplaydebug")
 {
-  pthread_mutex_init(&mutex, NULL);
   Glib::signal_timeout().connect(sigc::mem_fun(*this, &score_t::on_timeout),
                                  20);
 #ifndef GLIBMM_DEFAULT_SIGNAL_HANDLERS_ENABLED
@@ -649,9 +1013,6 @@ score_t::score_t(const std::string& srvaddr, const std::string& srvport,
 score_t::~score_t()
 {
   osc_server_t::deactivate();
-  pthread_mutex_trylock(&mutex);
-  pthread_mutex_unlock(&mutex);
-  pthread_mutex_destroy(&mutex);
 }
 
 void score_t::draw(Cairo::RefPtr<Cairo::Context> cr)
@@ -661,19 +1022,35 @@ void score_t::draw(Cairo::RefPtr<Cairo::Context> cr)
   cr->select_font_face("Emmentaler-16", Cairo::FONT_SLANT_NORMAL,
                        Cairo::FONT_WEIGHT_NORMAL);
   cr->set_font_size(8);
-  // start access to data:
-  pthread_mutex_lock(&mutex);
   // clean time database:
   double t0(time - history);
-  while(xpositions.size() > 1 && (xpositions.begin()->first < t0))
-    xpositions.erase(xpositions.begin());
+  while(xpositions.size() > 1 && (xpositions.time(0) < t0))
+    xpositions.pop_front();
+  // keep time and key signatures which are valid at t0:
+  while(timesig.size() > 1 && (timesig.time(1) <= t0))
+    timesig.pop_front();
+  while(keysig.size() > 1 && (keysig.time(1) <= t0))
+    keysig.pop_front();
   for(std::vector<staff_t>::iterator staff = staves.begin();
       staff != staves.end(); ++staff)
     staff->clear_music(t0);
+  // scroll layout, such that the oldest music is at the left edge:
+  double tpos(0);
+  double prev_tpos(0);
+  if(xpositions.size()) {
+    prev_tpos = xpositions.time(0);
+    tpos = xpositions.time(xpositions.size() - 1);
+    double xshift_target(-xpositions[0].x);
+    if(b_snap_scroll) {
+      xshift = xshift_target;
+      b_snap_scroll = false;
+    }
+    xshift += 0.05 * (xshift_target - xshift);
+  }
   // process graphical timing positions:
   // playhead marker:
   cr->save();
-  double x_marker(get_xpos(time - 5.1));
+  double x_marker(get_xpos(time - 5.1) + xshift);
   for(uint32_t k = 1; k < 5; k++) {
     double w(3.0);
     w = w / (w + k);
@@ -688,83 +1065,130 @@ void score_t::draw(Cairo::RefPtr<Cairo::Context> cr)
   for(std::vector<staff_t>::iterator staff = staves.begin();
       staff != staves.end(); ++staff)
     staff->draw_empty(cr);
-  // draw music:
-  double tpos(0);
-  if(xpositions.size()) {
-    tpos = xpositions.begin()->first;
-  }
-  if((tpos != prev_tpos) && (prev_tpos != -history)) {
-    xshift = xpositions[tpos];
+  if(b_clear_tiles) {
+    clear_tiles();
+    b_clear_tiles = false;
   }
-  xshift -= 0.05 * xshift;
-  // main music draw section:
-  double xpos(0);
-  //{
-  //  double tmp(-1);
-  //  if( xpositions.size() )
-  //    tmp = xpositions.begin()->first;
-  //  debugfile << time << ", " << xshift << ", " << x_marker << ", " <<
-  //  xpositions.size() << ", " << tmp << ", " << x_left << std::endl;
-  //}
-  for(std::map<double, double>::iterator xp = xpositions.begin();
-      xp != xpositions.end(); ++xp) {
-    double lspace(0);
-    double rspace(0);
-    double tsspace(0);
-    // get graphical extension of music and non-music:
-    std::map<double, graphical_time_signature_t>::iterator ts(
-        timesig.find(xp->first));
-    if(ts != timesig.end()) {
-      tsspace = ts->second.space(cr);
+  // all music is drawn in layout coordinates:
+  cr->save();
+  cr->translate(x_left + xshift, 0);
+  // snap the origin to whole device pixels, so that tiles and live
+  // music are drawn at the same subpixel position:
+  double dev_x0(0.0);
+  double dev_y0(0.0);
+  cr->user_to_device(dev_x0, dev_y0);
+  double snap_x(round(dev_x0) - dev_x0);
+  double snap_y(round(dev_y0) - dev_y0);
+  cr->device_to_user_distance(snap_x, snap_y);
+  cr->translate(snap_x, snap_y);
+  dev_x0 = round(dev_x0);
+  dev_y0 = round(dev_y0);
+  if(xpositions.size()) {
+    // visible range in layout coordinates, the view is 250 units wide:
+    double x_visible0(-125.0 - x_left - xshift);
+    double x_visible1(125.0 - x_left - xshift);
+    // hide music which was removed from the database:
+    x_visible0 = std::max(x_visible0, xpositions[0].x - 1.5);
+    cr->rectangle(x_visible0, -1000, x_visible1 - x_visible0, 2000);
+    cr->clip();
+    // all strips before the newest time position are completed:
+    int32_t strip_live(
+        floor((xpositions[xpositions.size() - 1].x - 2.0) / tile_width));
+    int32_t strip0(floor(x_visible0 / tile_width));
+    // recycle tiles which scrolled out of view:
+    while(tiles.size() && (tiles.begin()->first < strip0)) {
+      tile_pool.push_back(tiles.begin()->second);
+      tiles.erase(tiles.begin());
     }
-    for(std::vector<staff_t>::iterator staff = staves.begin();
-        staff != staves.end(); ++staff) {
-      lspace = std::max(lspace, staff->left_space(cr, xp->first));
-      rspace = std::max(rspace, staff->right_space(cr, xp->first));
+    // composite completed strips:
+    if(tile_height > 0) {
+      for(int32_t strip = strip0; strip < strip_live; ++strip) {
+        std::map<int32_t, Cairo::RefPtr<Cairo::ImageSurface>>::iterator tile(
+            tiles.find(strip));
+        if(tile == tiles.end())
+          tile = tiles
+                     .insert(std::make_pair(
+                         strip, render_tile(strip, prev_tpos, tpos)))
+                     .first;
+        // pixel grid of the tile, see render_tile():
+        double dev_x(dev_x0 + floor(strip * tile_width * tile_scale));
+        double dev_y(dev_y0 - floor(0.5 * tile_height));
+        cr->save();
+        cr->set_identity_matrix();
+        cr->set_source(tile->second, dev_x, dev_y);
+        cr->paint();
+        cr->restore();
+      }
     }
-    // increase x-position by left space
-    xpos += tsspace + lspace + (xp->first - tpos) * timescale;
+    // draw newest music directly:
+    double x_live(x_visible0);
+    if(tile_height > 0)
+      x_live = std::max(x_live, strip_live * tile_width);
+    cr->rectangle(x_live, -1000, x_visible1 - x_live, 2000);
+    cr->clip();
+    draw_music(cr, x_live, x_visible1, prev_tpos, tpos);
+  }
+  cr->restore();
+}
+
+/**
+   \brief Draw music of all time positions in a range of layout coordinates
+
+   \param cr Cairo context, translated to layout coordinates
+   \param x0 Left edge of range
+   \param x1 Right edge of range
+   \param t_first Time of oldest time position
+   \param t_last Time of newest time position
+ */
+void score_t::draw_music(Cairo::RefPtr<Cairo::Context> cr, double x0,
+                         double x1, double t_first, double t_last)
+{
+  // space for glyphs and text extending beyond their position:
+  double margin(40);
+  double prev_tpos(t_first);
+  double tpos(t_last);
+  // main music draw section:
+  for(uint32_t k = 0; k < xpositions.size(); ++k) {
+    const xposition_t& xp(xpositions[k]);
+    if((xp.xend + margin < x0) || (xp.x - margin > x1))
+      continue;
+    double t(xpositions.time(k));
     // draw time signature and music
-    if(ts != timesig.end()) {
+    uint32_t ts(timesig.find(t));
+    if(ts < timesig.size()) {
       for(std::vector<staff_t>::iterator staff = staves.begin();
           staff != staves.end(); ++staff)
-        ts->second.draw(cr, xpos + xshift + x_left - lspace, staff->y_0);
+        timesig[ts].draw(cr, xp.x + timesig[ts].space(), staff->y_0);
     }
     for(std::vector<staff_t>::iterator staff = staves.begin();
         staff != staves.end(); ++staff)
-      staff->draw_music(cr, xp->first, xpos + xshift + x_left);
-    xp->second = xpos + xshift - lspace - tsspace;
-    xpos += rspace;
-    if(xp == xpositions.begin()) {
-      prev_tpos = tpos;
-    }
-    tpos = xp->first;
+      staff->draw_music(cr, t, xp.xnote);
   }
   // draw bar lines here:
   if(!timesig.empty()) {
     double bar_endtime(tpos);
-    for(std::map<double, graphical_time_signature_t>::reverse_iterator it =
-            timesig.rbegin();
-        it != timesig.rend(); ++it) {
+    for(uint32_t k = timesig.size(); k > 0; --k) {
+      const graphical_time_signature_t* it(&timesig[k - 1]);
       if(bar_endtime > prev_tpos) {
-        double bar_starttime(std::max(prev_tpos, it->second.starttime));
-        // double bar_starttime(std::max(tpos, it->second.starttime));
+        double bar_starttime(std::max(prev_tpos, it->starttime));
         if(bar_starttime >= 0) {
           // draw bar lines from ... to bar_endtime
-          for(double bar = ceil(it->second.bar(bar_starttime));
-              bar < ceil(it->second.bar(bar_endtime)); bar += 1) {
+          for(double bar = ceil(it->bar(bar_starttime));
+              bar < ceil(it->bar(bar_endtime)); bar += 1) {
             if(bar > 0) {
-              double xbar(get_xpos(it->second.time(bar)) - 1.0);
-              if(it->second.time(bar) == it->first)
-                xbar += it->second.space(cr);
+              double xbar(get_xpos(it->time(bar)) - 1.0);
+              if(it->time(bar) == timesig.time(k - 1))
+                xbar += it->space();
+              if((xbar + margin < x0) || (xbar - margin > x1))
+                continue;
               // bar numbers for debugging:
               cr->save();
               cr->select_font_face("Arial", Cairo::FONT_SLANT_NORMAL,
                                    Cairo::FONT_WEIGHT_NORMAL);
               cr->set_font_size(3);
               char ctmp[40];
-              cr->move_to(x_left + xbar, -(staves.begin()->y_0 + 10));
-              sprintf(ctmp, "%g (%g)", bar, it->second.time(bar));
+              cr->move_to(xbar, -(staves.begin()->y_0 + 10));
+              sprintf(ctmp, "%g (%g)", bar, it->time(bar));
               cr->show_text(ctmp);
               cr->restore();
               // end bar numbers.
@@ -773,8 +1197,8 @@ void score_t::draw(Cairo::RefPtr<Cairo::Context> cr)
                 std::vector<staff_t>::iterator nstaff(staff);
                 nstaff++;
                 if(nstaff != staves.end()) {
-                  cr->move_to(x_left + xbar, -(staff->y_0 - 4));
-                  cr->line_to(x_left + xbar, -(nstaff->y_0 + 4));
+                  cr->move_to(xbar, -(staff->y_0 - 4));
+                  cr->line_to(xbar, -(nstaff->y_0 + 4));
                   cr->stroke();
                 }
               }
@@ -782,30 +1206,102 @@ void score_t::draw(Cairo::RefPtr<Cairo::Context> cr)
           }
         }
       }
-      bar_endtime = std::min(it->second.starttime, tpos);
+      bar_endtime = std::min(it->starttime, tpos);
     }
   }
 #ifdef DRAWKEY
   // draw key signature here:
-  for(std::map<double, keysig_t>::iterator ks = keysig.begin();
-      ks != keysig.end(); ++ks) {
-    if((ks->first >= prev_tpos) && (ks->first <= tpos)) {
-      double xpos(get_xpos(ks->first));
-      std::map<double, graphical_time_signature_t>::iterator ts(
-          timesig.find(ks->first));
-      if(ts != timesig.end())
-        xpos += ts->second.space(cr);
+  for(uint32_t ks = 0; ks < keysig.size(); ++ks) {
+    double t(keysig.time(ks));
+    if((t >= prev_tpos) && (t <= tpos)) {
+      double xpos(get_xpos(t));
+      uint32_t ts(timesig.find(t));
+      if(ts < timesig.size())
+        xpos += timesig[ts].space();
+      if((xpos + margin < x0) || (xpos - margin > x1))
+        continue;
       cr->save();
-      cr->move_to(x_left + xpos, -staves.rbegin()->y_0 + 12);
+      cr->move_to(xpos, -staves.rbegin()->y_0 + 12);
       cr->select_font_face("Arial", Cairo::FONT_SLANT_NORMAL,
                            Cairo::FONT_WEIGHT_BOLD);
       cr->set_font_size(6);
-      cr->show_text(ks->second.name().c_str());
+      cr->show_text(keysig[ks].name().c_str());
       cr->restore();
     }
   }
 #endif
-  pthread_mutex_unlock(&mutex);
+}
+
+/**
+   \brief Set size of offscreen tiles
+
+   Tiles are invalidated if the geometry changed.
+
+   \param scale Device pixels per layout unit
+   \param height Tile height in device pixels
+ */
+void score_t::set_tile_geometry(double scale, int height)
+{
+  if((scale != tile_scale) || (height != tile_height)) {
+    clear_tiles();
+    tile_pool.clear();
+    tile_scale = scale;
+    tile_height = height;
+  }
+}
+
+/**
+   \brief Return all tiles to the pool
+ */
+void score_t::clear_tiles()
+{
+  for(std::map<int32_t, Cairo::RefPtr<Cairo::ImageSurface>>::iterator tile =
+          tiles.begin();
+      tile != tiles.end(); ++tile)
+    tile_pool.push_back(tile->second);
+  tiles.clear();
+}
+
+/**
+   \brief Render completed music of one strip into an offscreen surface
+
+   The surface is taken from the pool of recycled tiles if possible.
+   The first pixel column of the tile is the device pixel column of
+   the strip start, rounded down, so that the tile is composited
+   without resampling at an origin on whole device pixels.
+ */
+Cairo::RefPtr<Cairo::ImageSurface>
+score_t::render_tile(int32_t strip, double t_first, double t_last)
+{
+  Cairo::RefPtr<Cairo::ImageSurface> surface;
+  if(tile_pool.size()) {
+    surface = tile_pool.back();
+    tile_pool.pop_back();
+  } else {
+    surface = Cairo::ImageSurface::create(
+        Cairo::FORMAT_ARGB32, ceil(tile_width * tile_scale) + 1, tile_height);
+  }
+  Cairo::RefPtr<Cairo::Context> cr(Cairo::Context::create(surface));
+  cr->save();
+  cr->set_operator(Cairo::OPERATOR_CLEAR);
+  cr->paint();
+  cr->restore();
+  const double x0(strip * tile_width);
+  const double x1(x0 + tile_width);
+  cr->translate(x0 * tile_scale - floor(x0 * tile_scale),
+                floor(0.5 * tile_height));
+  cr->scale(tile_scale, tile_scale);
+  cr->translate(-x0, 0);
+  cr->set_line_width(0.2);
+  cr->set_source_rgb(0, 0, 0);
+  cr->select_font_face("Emmentaler-16", Cairo::FONT_SLANT_NORMAL,
+                       Cairo::FONT_WEIGHT_NORMAL);
+  cr->set_font_size(8);
+  cr->rectangle(x0, -1000, tile_width, 2000);
+  cr->clip();
+  draw_music(cr, x0, x1, t_first, t_last);
+  surface->flush();
+  return surface;
 }
 
 bool score_t::on_draw(const Cairo::RefPtr<Cairo::Context>& cr)
@@ -819,6 +1315,7 @@ bool score_t::on_draw(const Cairo::RefPtr<Cairo::Context>& cr)
   cr->translate(0.5 * width, 0.5 * height);
   cr->scale(0.004 * width, 0.004 * width);
   cr->set_line_width(0.2);
+  set_tile_geometry(0.004 * width, height);
   cr->save();
   cr->set_source_rgb(1, 1, 1);
   cr->paint();
@@ -830,6 +1327,7 @@ bool score_t::on_draw(const Cairo::RefPtr<Cairo::Context>& cr)
 
 bool score_t::on_timeout()
 {
+  process_events();
   // force our program to redraw the entire score
   Glib::RefPtr<Gdk::Window> win = get_window();
   if(win) {
@@ -1,5 +1,6 @@
 #include "hos_defs.h"
 #include "libhos_audiochunks.h"
+#include "rampedvalue.h"
 #include <fstream>
 #include <getopt.h>
 #include <iostream>
@@ -166,16 +167,6 @@ public:
   void open_notes(const std::string& fname);
   void set_t0(double t0);
   void set_loop_time(double tloop) { loop_time = tloop; };
-  void set_gain(float newgain, double duration)
-  {
-    dgain = (newgain - mastergain) / (duration * srate);
-    tfader = srate * duration;
-  };
-  void set_auxgain(float newgain, double duration)
-  {
-    dauxgain = (newgain - auxgain) / (duration * srate);
-    tauxfader = srate * duration;
-  };
   void quit() { b_quit = true; };
   static int osc_set_t0(const char* path, const char* types, lo_arg** argv,
                         int argc, lo_message msg, void* user_data);
@@ -190,10 +181,6 @@ public:
                           int argc, lo_message msg, void* user_data);
   static int osc_clearloop(const char* path, const char* types, lo_arg** argv,
                            int argc, lo_message msg, void* user_data);
-  static int osc_set_gain(const char* path, const char* types, lo_arg** argv,
-                          int argc, lo_message msg, void* user_data);
-  static int osc_set_auxgain(const char* path, const char* types, lo_arg** argv,
-                             int argc, lo_message msg, void* user_data);
 
 private:
   std::vector<looped_sndfile_t*> sounds;
@@ -207,12 +194,8 @@ private:
   float* vgain;
   float* vauxgain;
   double loop_time;
-  double mastergain;
-  uint32_t tfader;
-  double dgain;
-  double auxgain;
-  uint32_t tauxfader;
-  double dauxgain;
+  HoS::ramped_value_t<float> mastergain;
+  HoS::ramped_value_t<float> auxgain;
   lo_address lo_addr;
   bool b_announce;
   int32_t barno;
@@ -222,8 +205,8 @@ sampler_t::sampler_t(const std::string& jname, const std::string& announce)
     : jackc_t(jname), osc_server_t("239.255.1.7", "6978", "UDP"),
       timescale(1.0), current_time(-1), last_phase(0), b_quit(false),
       vtime(new double[fragsize]), vgain(new float[fragsize]),
-      vauxgain(new float[fragsize]), loop_time(0), mastergain(0.0), tfader(0),
-      dgain(0.0), auxgain(0.0), tauxfader(0), dauxgain(0.0),
+      vauxgain(new float[fragsize]), loop_time(0), mastergain(0.0f, srate),
+      auxgain(0.0f, srate),
       b_announce(!announce.empty()), barno(-100)
 {
   add_input_port("phase");
@@ -232,10 +215,10 @@ sampler_t::sampler_t(const std::string& jname, const std::string& announce)
   set_prefix("/" + jname);
   add_method("/t0", "f", sampler_t::osc_set_t0, this);
   add_method("/loop", "f", sampler_t::osc_set_loop_time, this);
-  add_double("/gain", &mastergain);
-  add_method("/gain", "ff", osc_set_gain, this);
-  add_double("/auxgain", &auxgain);
-  add_method("/auxgain", "ff", osc_set_auxgain, this);
+  add_method("/gain", "d", HoS::osc_set_ramp<float>, &mastergain);
+  add_method("/gain", "ff", HoS::osc_set_ramp<float>, &mastergain);
+  add_method("/auxgain", "d", HoS::osc_set_ramp<float>, &auxgain);
+  add_method("/auxgain", "ff", HoS::osc_set_ramp<float>, &auxgain);
   add_double("/timescale", &timescale);
   add_method("/quit", "", sampler_t::osc_quit, this);
   if(b_announce)
@@ -270,25 +253,6 @@ int sampler_t::osc_addloop(const char* path, const char* types, lo_arg** argv,
   return 0;
 }
 
-int sampler_t::osc_set_gain(const char* path, const char* types, lo_arg** argv,
-                            int argc, lo_message msg, void* user_data)
-{
-  if((user_data) && (argc == 2) && (types[0] == 'f') && (types[1] == 'f')) {
-    ((sampler_t*)user_data)->set_gain(argv[0]->f, argv[1]->f);
-  }
-  return 0;
-}
-
-int sampler_t::osc_set_auxgain(const char* path, const char* types,
-                               lo_arg** argv, int argc, lo_message msg,
-                               void* user_data)
-{
-  if((user_data) && (argc == 2) && (types[0] == 'f') && (types[1] == 'f')) {
-    ((sampler_t*)user_data)->set_auxgain(argv[0]->f, argv[1]->f);
-  }
-  return 0;
-}
-
 int sampler_t::osc_stoploop(const char* path, const char* types, lo_arg** argv,
                             int argc, lo_message msg, void* user_data)
 {
@@ -338,6 +302,8 @@ int sampler_t::process(jack_nframes_t n, const std::vector<float*>& sIn,
   //  wave_t wout(n,sOut[k+1]);
   //  sounds[k]->loop(wout);
   //}
+  mastergain.update();
+  auxgain.update();
   float* vPhase(sIn[0]);
   for(uint32_t k = 0; k < n; k++) {
     double dphase(vPhase[k] - last_phase);
@@ -356,17 +322,9 @@ int sampler_t::process(jack_nframes_t n, const std::vector<float*>& sIn,
         lo_send(lo_addr, "/bar", "i", newbarno);
       barno = newbarno;
     }
-    if(tfader) {
-      mastergain += dgain;
-      tfader--;
-    }
-    vgain[k] = mastergain;
-    if(tauxfader) {
-      auxgain += dauxgain;
-      tauxfader--;
-    }
-    vauxgain[k] = auxgain;
   }
+  mastergain.process(vgain, n);
+  auxgain.process(vauxgain, n);
   // std::cerr << chunk_time << ",..." << std::endl;
   //  DEBUG(chunk_time);
   for(unsigned int kn = 0; kn < notes.size(); kn++) {
@@ -28,37 +28,83 @@
 
 #include "ambpan.h"
 #include "filter.h"
+#include "libhos_random.h"
 #include "libhos_sphereparam.h"
+#include "triplebuffer.h"
+#include <atomic>
+#include <getopt.h>
 #include <iostream>
 #include <stdlib.h>
+#include <string.h>
+#include <tascar/errorhandling.h>
 #include <tascar/jackclient.h>
+#include <thread>
 #include <unistd.h>
 using namespace HoS;
 
 namespace HoS {
 
+  /**
+     \brief Panning targets of one source for the next update interval
+  */
+  class source_target_t {
+  public:
+    float dry[amb_coeff::channels];
+    float wet_left[amb_coeff::channels];
+    float wet_right[amb_coeff::channels];
+    float g_in = 1.0f;
+    float g_rvb = 1.0f;
+  };
+
   /**
      \ingroup apphos
+     \brief Virtual source on a cyclic trajectory
+
+     The trajectory parameters are controlled via OSC under the prefix
+     "/<name>/". The trajectory is computed in the control thread,
+     the audio thread only interpolates the panning coefficients. The
+     random components are drawn from a generator seeded by the name,
+     independent of the other sources.
   */
-  class sphere_amb30_t : public jackc_t, private HoS::parameter_t {
+  class sphere_source_t : private HoS::parameter_t {
   public:
-    sphere_amb30_t(const std::string& name);
-    void run();
+    sphere_source_t(TASCAR::osc_server_t& srv, const std::string& name,
+                    double f_sample, unsigned int dt_update);
+    /**
+       \brief Advance the trajectory by one update interval (control
+       thread)
+    */
+    void update_trajectory(source_target_t& target);
+    /**
+       \brief Send current position via OSC (control thread)
+    */
+    void send_feedback();
+    /**
+       \brief Start interpolation towards new targets (audio thread)
+    */
+    void set_target(const source_target_t& target);
+    /**
+       \brief Pan a block of samples and add to the B-format bus
+       \param n Number of samples
+       \param direct Direct input signal
+       \param wet_left Left reverb input signal
+       \param wet_right Right reverb input signal
+       \param rvb Reverb send output
+       \param bus Seven B-format channels
+    */
+    void process(uint32_t n, const float* direct, const float* wet_left,
+                 const float* wet_right, float* rvb, float* const* bus);
+    bool quit() const { return b_quit; };
 
   private:
-    void update_trajectory();
-    int process(jack_nframes_t nframes, const std::vector<float*>& inBuffer,
-                const std::vector<float*>& outBuffer);
+    /// Uniform random number in (0,1):
+    double uniform() { return 2.3283064370807974e-10 * rng(); };
     // osc address for feedback:
     std::string pos_addr;
     // audio sample frequency:
     double f_sample;
     // timing control for parameter update:
     unsigned int dt_update;
-    unsigned int t_update;
-    // timing control for position feedback:
-    unsigned int dt_feedback;
-    unsigned int t_feedback;
     // parameter update frequency:
     double f_update;
     // Ambisonics panner:
@@ -69,26 +115,97 @@ namespace HoS {
     // onset detector (for Paert):
     onset_detector ons;
     float ons_crit;
+    // onset detector output, passed to the control thread:
+    std::atomic<float> ons_level;
     float t_randpos;
+    // input and reverb gains of current update interval:
+    float g_in;
+    float g_rvb;
+    xorshift_t rng;
+  };
+
+  /**
+     \ingroup apphos
+     \brief Virtual sources on cyclic trajectories, panned into a
+     common 3rd order horizontal ambisonics bus
+
+     All sources share one OSC server.
+  */
+  class sphere_amb30_t : public jackc_t, public TASCAR::osc_server_t {
+  public:
+    sphere_amb30_t(const std::string& jackname,
+                   const std::vector<std::string>& names);
+    ~sphere_amb30_t();
+    void run();
+
+  private:
+    int process(jack_nframes_t nframes, const std::vector<float*>& inBuffer,
+                const std::vector<float*>& outBuffer);
+    bool quit() const;
+    void control_update();
+    void control_thread();
+    // timing control for parameter update:
+    unsigned int dt_update;
+    unsigned int t_update;
+    std::vector<sphere_source_t*> sources;
+    // panning targets, written by the control thread:
+    HoS::triple_buffer_t<std::vector<source_target_t>> targets;
+    // number of update intervals started by the audio thread:
+    std::atomic<uint32_t> ticks;
+    uint32_t ticks_done;
+    std::atomic<bool> b_run_control;
+    std::thread control;
   };
 
 } // namespace HoS
 
-sphere_amb30_t::sphere_amb30_t(const std::string& name)
-    : jackc_t(name), parameter_t(name), pos_addr("/pos/" + name),
-      f_sample(srate), dt_update(f_sample / 25.0), t_update(0),
-      dt_feedback(f_sample / 25.0), t_feedback(0),
-      f_update(f_sample / (double)dt_update), amb_dry(dt_update),
-      amb_wet_left(dt_update), amb_wet_right(dt_update), phi(0.0f),
-      phi_epi(0.0f), ons(f_sample), t_randpos(0)
+/*
+  FNV-1a hash of the name, to seed the random generator of a source.
+*/
+static uint32_t name_seed(const std::string& name)
+{
+  uint32_t h(2166136261u);
+  for(auto c : name) {
+    h ^= (uint8_t)c;
+    h *= 16777619u;
+  }
+  return h;
+}
+
+sphere_source_t::sphere_source_t(TASCAR::osc_server_t& srv,
+                                 const std::string& name, double f_sample_,
+                                 unsigned int dt_update_)
+    : parameter_t(srv, name), pos_addr("/pos/" + name), f_sample(f_sample_),
+      dt_update(dt_update_), f_update(f_sample / (double)dt_update),
+      amb_dry(dt_update), amb_wet_left(dt_update), amb_wet_right(dt_update),
+      phi(0.0f), phi_epi(0.0f), ons(f_sample), ons_crit(0.0f),
+      ons_level(0.0f), t_randpos(0), g_in(0.0f), g_rvb(0.0f),
+      rng(name_seed(name))
 {
-  for(unsigned int k = 0; k < name.size(); k++)
-    srand(name[k]);
   set_par_fupdate(f_update);
-  add_input_port("direct");
-  add_input_port("reverb_l");
-  add_input_port("reverb_r");
-  add_output_port("reverb");
+}
+
+sphere_amb30_t::sphere_amb30_t(const std::string& jackname,
+                               const std::vector<std::string>& names)
+    : jackc_t(jackname),
+      TASCAR::osc_server_t(SPHERE_OSC_ADDR, SPHERE_OSC_PORT, "UDP"),
+      dt_update(srate / 25.0), t_update(0),
+      targets(std::vector<source_target_t>(names.size())), ticks(0),
+      ticks_done(0), b_run_control(false)
+{
+  if(names.empty())
+    throw TASCAR::ErrMsg("No source names given.");
+  for(auto name : names) {
+    sources.push_back(new sphere_source_t(*this, name, srate, dt_update));
+    std::string pref;
+    if(names.size() > 1)
+      pref = name + ".";
+    add_input_port(pref + "direct");
+    add_input_port(pref + "reverb_l");
+    add_input_port(pref + "reverb_r");
+  }
+  for(auto name : names)
+    add_output_port((names.size() > 1) ? (name + ".reverb") : "reverb");
   add_output_port("0.W");
   add_output_port("1.X");
   add_output_port("1.Y");
@@ -96,7 +213,12 @@ sphere_amb30_t::sphere_amb30_t(const std::string& name)
   add_output_port("2.V");
   add_output_port("3.P");
   add_output_port("3.Q");
-  // DEBUG(1);
+}
+
+sphere_amb30_t::~sphere_amb30_t()
+{
+  for(auto src : sources)
+    delete src;
 }
 
 double phidiff(double p1, double p2)
@@ -113,8 +235,9 @@ bool iscrossing(double phi0, double phi, double lastphi)
          (fabs(pd1) < 0.5 * M_PI) && (fabs(pd2) < 0.5 * M_PI);
 }
 
-void sphere_amb30_t::update_trajectory()
+void sphere_source_t::update_trajectory(source_target_t& target)
 {
+  ons_crit = ons_level.load(std::memory_order_relaxed);
   // optionally apply dynamic parameters:
   if(t_apply) {
     t_apply--;
@@ -124,7 +247,7 @@ void sphere_amb30_t::update_trajectory()
     par_previous.assign_dynamic(par_current);
   }
   if((par_osc.randpos > ons_crit) && (t_randpos <= 0)) {
-    phi = rand() * PI2 / RAND_MAX;
+    phi = uniform() * PI2;
     t_randpos = 1.0 * f_sample;
   } else {
     if(t_randpos)
@@ -179,11 +302,11 @@ void sphere_amb30_t::update_trajectory()
   w_epi = par_current.f_epi * PI2 / f_update;
   // random component:
   double r;
-  r = (2.0 * rand() / RAND_MAX) - 0.7;
+  r = 2.0 * uniform() - 0.7;
   r *= r * r;
   r *= par_current.random;
   w_main += r;
-  r = (2.0 * rand() / RAND_MAX) - 0.7;
+  r = 2.0 * uniform() - 0.7;
   r *= r * r;
   r *= par_current.random;
   w_epi += r;
@@ -230,72 +353,166 @@ void sphere_amb30_t::update_trajectory()
   normd *= normd;
   float _width(par_current.width * 1.0f * normd / (normd * normd + 1.0f));
   float G(1.0f / (1.0f + normd));
-  // apply panning:
-  amb_dry.set(_az, par_current.elev, G);
-  amb_wet_left.set(_az + _width, par_current.rvbelev, 1.0f - G);
-  amb_wet_right.set(_az - _width, par_current.rvbelev, 1.0f - G);
+  // panning coefficients:
+  amb_coeff::coeff(_az, par_current.elev, G, target.dry);
+  amb_coeff::coeff(_az + _width, par_current.rvbelev, 1.0f - G,
+                   target.wet_left);
+  amb_coeff::coeff(_az - _width, par_current.rvbelev, 1.0f - G,
+                   target.wet_right);
+  target.g_in = par_current.g_in;
+  target.g_rvb = par_current.g_rvb;
+}
+
+void sphere_source_t::send_feedback()
+{
+  lo_send(lo_addr, pos_addr.c_str(), "ff", _az, _rho * cos(par_current.elev));
+}
+
+void sphere_source_t::set_target(const source_target_t& target)
+{
+  amb_dry.set(target.dry);
+  amb_wet_left.set(target.wet_left);
+  amb_wet_right.set(target.wet_right);
+  g_in = target.g_in;
+  g_rvb = target.g_rvb * target.g_in;
+}
+
+void sphere_source_t::process(uint32_t n, const float* direct,
+                              const float* wet_left, const float* wet_right,
+                              float* rvb, float* const* bus)
+{
+  for(uint32_t i = 0; i < n; ++i)
+    rvb[i] = g_rvb * direct[i];
+  float level(0.0f);
+  for(uint32_t i = 0; i < n; ++i)
+    level = ons.detect(g_in * direct[i]);
+  ons_level.store(level, std::memory_order_relaxed);
+  amb_dry.addpan30(direct, n, bus, g_in);
+  amb_wet_left.addpan30(wet_left, n, bus);
+  amb_wet_right.addpan30(wet_right, n, bus);
 }
 
 int sphere_amb30_t::process(jack_nframes_t nframes,
                             const std::vector<float*>& inBuffer,
                             const std::vector<float*>& outBuffer)
 {
-  // set_preset();
-  float* vRvb(outBuffer[0]);
-  float* vW(outBuffer[1]);
-  float* vX(outBuffer[2]);
-  float* vY(outBuffer[3]);
-  float* vU(outBuffer[4]);
-  float* vV(outBuffer[5]);
-  float* vP(outBuffer[6]);
-  float* vQ(outBuffer[7]);
-  // main loop:
-  for(jack_nframes_t i = 0; i < nframes; ++i) {
-    // well, this is not really real-time safe...
-    // we need asynchronous parameter update and feedback sending.
+  const uint32_t nsrc(sources.size());
+  float* const* bus(&(outBuffer[nsrc]));
+  for(uint32_t k = 0; k < 7; ++k)
+    memset(bus[k], 0, nframes * sizeof(float));
+  // process in segments between trajectory updates:
+  jack_nframes_t i0(0);
+  while(i0 < nframes) {
     if(!t_update) {
       t_update = dt_update;
-      update_trajectory();
+      // targets of the next interval, computed by the control thread:
+      const std::vector<source_target_t>& tg(targets.read());
+      for(uint32_t s = 0; s < nsrc; ++s)
+        sources[s]->set_target(tg[s]);
+      ticks.fetch_add(1, std::memory_order_release);
     }
-    t_update--;
-    if(!t_feedback) {
-      t_feedback = dt_feedback;
-      lo_send(lo_addr, pos_addr.c_str(), "ff", _az,
-              _rho * cos(par_current.elev));
-    }
-    t_feedback--;
-    float dry = par_current.g_in * inBuffer[0][i];
-    vRvb[i] = par_current.g_rvb * dry;
-    float wet_left = inBuffer[1][i];
-    float wet_right = inBuffer[2][i];
-    ons_crit = ons.detect(dry);
-    // calculate panning:
-    amb_dry.clear(vW[i], vX[i], vY[i], vU[i], vV[i], vP[i], vQ[i]);
-    amb_dry.addpan30(dry, vW[i], vX[i], vY[i], vU[i], vV[i], vP[i], vQ[i]);
-    amb_wet_left.addpan30(wet_left, vW[i], vX[i], vY[i], vU[i], vV[i], vP[i],
-                          vQ[i]);
-    amb_wet_right.addpan30(wet_right, vW[i], vX[i], vY[i], vU[i], vV[i], vP[i],
-                           vQ[i]);
+    uint32_t n(std::min(t_update, nframes - i0));
+    float* seg[7];
+    for(uint32_t k = 0; k < 7; ++k)
+      seg[k] = bus[k] + i0;
+    for(uint32_t s = 0; s < nsrc; ++s)
+      sources[s]->process(n, inBuffer[3 * s] + i0, inBuffer[3 * s + 1] + i0,
+                          inBuffer[3 * s + 2] + i0, outBuffer[s] + i0, seg);
+    t_update -= n;
+    i0 += n;
   }
   return 0;
 }
 
+bool sphere_amb30_t::quit() const
+{
+  for(auto src : sources)
+    if(src->quit())
+      return true;
+  return false;
+}
+
+void sphere_amb30_t::control_update()
+{
+  std::vector<source_target_t>& tg(targets.write_buffer());
+  for(uint32_t s = 0; s < sources.size(); ++s) {
+    sources[s]->update_trajectory(tg[s]);
+    sources[s]->send_feedback();
+  }
+  targets.publish();
+}
+
+void sphere_amb30_t::control_thread()
+{
+  while(b_run_control) {
+    // one trajectory update for each interval started by the audio
+    // thread, so the trajectory speed does not depend on timing:
+    while(ticks_done != ticks.load(std::memory_order_acquire)) {
+      ++ticks_done;
+      control_update();
+    }
+    usleep(1000);
+  }
+}
+
 void sphere_amb30_t::run()
 {
+  // targets for the first interval:
+  control_update();
+  b_run_control = true;
+  control = std::thread(&sphere_amb30_t::control_thread, this);
   jackc_t::activate();
-  while(!b_quit) {
+  TASCAR::osc_server_t::activate();
+  while(!quit()) {
     sleep(1);
   }
+  TASCAR::osc_server_t::deactivate();
   jackc_t::deactivate();
+  b_run_control = false;
+  control.join();
+}
+
+void usage(struct option* opt)
+{
+  std::cout << "Usage:\n\nhos_sphere_amb30 [options] [name ...]\n\n"
+               "Each name creates one source, controlled via OSC under the "
+               "prefix /name/.\n\nOptions:\n\n";
+  while(opt->name) {
+    std::cout << "  -" << (char)(opt->val) << " " << (opt->has_arg ? "#" : "")
+              << "\n  --" << opt->name << (opt->has_arg ? "=#" : "") << "\n\n";
+    opt++;
+  }
 }
 
 int main(int argc, char** argv)
 {
-  std::string name("sphere");
-  if(argc > 1)
-    name = argv[1];
-  sphere_amb30_t S(name);
+  std::string jackname;
+  std::vector<std::string> names;
+  const char* options = "hj:";
+  struct option long_options[] = {
+      {"help", 0, 0, 'h'}, {"jackname", 1, 0, 'j'}, {0, 0, 0, 0}};
+  int opt(0);
+  int option_index(0);
+  while((opt = getopt_long(argc, argv, options, long_options, &option_index)) !=
+        -1) {
+    switch(opt) {
+    case 'h':
+      usage(long_options);
+      return -1;
+    case 'j':
+      jackname = optarg;
+      break;
+    }
+  }
+  while(optind < argc)
+    names.push_back(argv[optind++]);
+  if(names.empty())
+    names.push_back("sphere");
+  if(jackname.empty())
+    jackname = (names.size() > 1) ? "sphere" : names[0];
+  sphere_amb30_t S(jackname, names);
   S.run();
+  return 0;
 }
 
 /*
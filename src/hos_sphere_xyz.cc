@@ -25,10 +25,14 @@
 */
 
 #include "filter.h"
-#include "jackclient.h"
 #include "libhos_sphereparam.h"
+#include "triplebuffer.h"
+#include <atomic>
 #include <iostream>
 #include <stdlib.h>
+#include <tascar/jackclient.h>
+#include <thread>
+#include <unistd.h>
 
 #define OSC_ADDR "239.255.1.7"
 #define OSC_PORT "6978"
@@ -75,13 +79,22 @@ namespace HoS {
   /**
       \ingroup apphos
   */
-  class sphere_xyz_t : public jackc_t, private parameter_t {
+  class sphere_xyz_t : public jackc_t,
+                       public TASCAR::osc_server_t,
+                       private parameter_t {
   public:
     sphere_xyz_t(const std::string& name);
     void run();
 
   private:
+    class xyz_t {
+    public:
+      float x = 0.0f;
+      float y = 0.0f;
+      float z = 0.0f;
+    };
     void update_trajectory();
+    void control_thread();
     int process(jack_nframes_t nframes, const std::vector<float*>& inBuffer,
                 const std::vector<float*>& outBuffer);
     // osc address for feedback:
@@ -91,9 +104,13 @@ namespace HoS {
     // timing control for parameter update:
     unsigned int dt_update;
     unsigned int t_update;
-    // timing control for position feedback:
-    unsigned int dt_feedback;
-    unsigned int t_feedback;
+    // target position, written by the control thread:
+    HoS::triple_buffer_t<xyz_t> target;
+    // number of update intervals started by the audio thread:
+    std::atomic<uint32_t> ticks;
+    uint32_t ticks_done;
+    std::atomic<bool> b_run_control;
+    std::thread control;
     // parameter update frequency:
     double f_update;
     pos_interp_t pos_interp;
@@ -109,13 +126,15 @@ namespace HoS {
 }; // namespace HoS
 
 sphere_xyz_t::sphere_xyz_t(const std::string& name)
-    : jackc_t(name), parameter_t(name), pos_addr("/pos/" + name),
+    : jackc_t(name),
+      TASCAR::osc_server_t(SPHERE_OSC_ADDR, SPHERE_OSC_PORT, "UDP"),
+      parameter_t(*this, name), pos_addr("/pos/" + name),
       f_sample(srate), dt_update(f_sample / 25.0), t_update(0),
-      dt_feedback(f_sample / 25.0), t_feedback(0),
+      target(xyz_t()), ticks(0), ticks_done(0), b_run_control(false),
       f_update(f_sample / (double)dt_update), pos_interp(dt_update), phi(0.0f),
       phi_epi(0.0f),
       // ons(f_sample),
-      t_randpos(0)
+      ons_crit(0.0f), t_randpos(0)
 {
   for(unsigned int k = 0; k < name.size(); k++)
     srand(name[k]);
@@ -253,8 +272,25 @@ void sphere_xyz_t::update_trajectory()
     apply(applyat_time);
   }
   lastphi = phi;
-  // apply panning:
-  pos_interp.set(x, y, 0);
+  xyz_t& pos(target.write_buffer());
+  pos.x = x;
+  pos.y = y;
+  pos.z = 0.0f;
+  target.publish();
+  lo_send(lo_addr, pos_addr.c_str(), "ff", _az, _rho * cos(par_current.elev));
+}
+
+void sphere_xyz_t::control_thread()
+{
+  while(b_run_control) {
+    // one trajectory update for each interval started by the audio
+    // thread, so the trajectory speed does not depend on timing:
+    while(ticks_done != ticks.load(std::memory_order_acquire)) {
+      ++ticks_done;
+      update_trajectory();
+    }
+    usleep(1000);
+  }
 }
 
 int sphere_xyz_t::process(jack_nframes_t nframes,
@@ -266,19 +302,14 @@ int sphere_xyz_t::process(jack_nframes_t nframes,
   float* vZ(outBuffer[2]);
   // main loop:
   for(jack_nframes_t i = 0; i < nframes; ++i) {
-    // well, this is not really real-time safe...
-    // we need asynchronous parameter update and feedback sending.
     if(!t_update) {
       t_update = dt_update;
-      update_trajectory();
+      // target of the next interval, computed by the control thread:
+      const xyz_t& pos(target.read());
+      pos_interp.set(pos.x, pos.y, pos.z);
+      ticks.fetch_add(1, std::memory_order_release);
     }
     t_update--;
-    if(!t_feedback) {
-      t_feedback = dt_feedback;
-      lo_send(lo_addr, pos_addr.c_str(), "ff", _az,
-              _rho * cos(par_current.elev));
-    }
-    t_feedback--;
     // float dry = par_current.g_in * inBuffer[0][i];
     // ons_crit = ons.detect( dry );
     // calculate panning:
@@ -289,11 +320,19 @@ int sphere_xyz_t::process(jack_nframes_t nframes,
 
 void sphere_xyz_t::run()
 {
-  activate();
+  // target for the first interval:
+  update_trajectory();
+  b_run_control = true;
+  control = std::thread(&sphere_xyz_t::control_thread, this);
+  jackc_t::activate();
+  TASCAR::osc_server_t::activate();
   while(!b_quit) {
     sleep(1);
   }
-  deactivate();
+  TASCAR::osc_server_t::deactivate();
+  jackc_t::deactivate();
+  b_run_control = false;
+  control.join();
 }
 
 int main(int argc, char** argv)
@@ -1,12 +1,9 @@
-#include "libhos_audiochunks.h"
-#include <complex.h>
+#include "libhos_spksim.h"
 #include <getopt.h>
 #include <iostream>
-#include <limits>
 #include <math.h>
 #include <signal.h>
 #include <stdlib.h>
-#include <string.h>
 #include <tascar/jackclient.h>
 #include <tascar/osc_helper.h>
 #include <unistd.h>
@@ -17,33 +14,35 @@ class dc_t : public jackc_t, public TASCAR::osc_server_t {
 public:
   dc_t(const std::string& jackname, const std::string& server_address,
        const std::string& server_port, const std::vector<std::string>& names,
-       float c_, float fc, float q_);
-  ~dc_t();
+       float c_, float fc, float q_, uint32_t oversampling);
   int process(jack_nframes_t n, const std::vector<float*>& inBuf,
               const std::vector<float*>& outBuf);
+  void print_load();
 
 private:
   double c;
   double f;
   double q;
   double g;
-  double b1;
-  double b2;
-  double* statex;
-  double* statey1;
-  double* statey2;
+  // parameters of the current coefficients:
+  double c_used;
+  double f_used;
+  double q_used;
+  double g_used;
+  HoS::spksim_t spk;
 };
 
 dc_t::dc_t(const std::string& jackname, const std::string& server_address,
            const std::string& server_port,
-           const std::vector<std::string>& names, float c_, float fc, float q_)
+           const std::vector<std::string>& names, float c_, float fc, float q_,
+           uint32_t oversampling)
     : jackc_t(jackname), osc_server_t(server_address, server_port, "UDP"),
-      c(c_), f(fc), q(q_), g(0), statex(new double[names.size()]),
-      statey1(new double[names.size()]), statey2(new double[names.size()])
+      c(c_), f(fc), q(q_), g(0), c_used(c), f_used(f), q_used(q),
+      g_used(g), spk(names.size(), srate, oversampling)
 {
-  memset(statex, 0, sizeof(double) * names.size());
-  memset(statey1, 0, sizeof(double) * names.size());
-  memset(statey2, 0, sizeof(double) * names.size());
+  spk.set_resonance(f, q);
+  spk.set_clipping(c);
+  spk.set_differentiator(false, true);
   for(uint32_t k = 0; k < names.size(); k++) {
     add_input_port("in." + names[k]);
     add_output_port("out." + names[k]);
@@ -55,48 +54,34 @@ dc_t::dc_t(const std::string& jackname, const std::string& server_address,
   add_double("g", &g);
 }
 
-dc_t::~dc_t()
-{
-  delete[] statex;
-  delete[] statey1;
-  delete[] statey2;
-}
-
-std::complex<double> I = 1i;
-
 int dc_t::process(jack_nframes_t n, const std::vector<float*>& inBuf,
                   const std::vector<float*>& outBuf)
 {
-  b1 = 2.0 * q * cos(2.0 * M_PI * f / srate);
-  b2 = -q * q;
-  std::complex<double> z(std::exp(I * 2.0 * M_PI * f / (double)srate));
-  std::complex<double> z0(q * std::exp(-I * 2.0 * M_PI * f / (double)srate));
-  double a1((1.0 - q) * (std::abs(z - z0)));
-  double og(pow(10.0, 0.05 * g));
-  for(uint32_t ch = 0; ch < inBuf.size(); ch++) {
-    float* vx(inBuf[ch]);
-    float* vy(outBuf[ch]);
-    for(uint32_t k = 0; k < n; k++) {
-      // input resonance filter:
-      make_friendly_number_limited(vx[k]);
-      double y(a1 * vx[k] + b1 * statey1[ch] + b2 * statey2[ch]);
-      make_friendly_number_limited(y);
-      statey2[ch] = statey1[ch];
-      statey1[ch] = y;
-      // non-linearity:
-      y *= c / (c + fabs(y));
-      // air coupling to velocity:
-      vy[k] = og * (y - statex[ch]);
-      statex[ch] = y;
-      // statex[ch] = std::max(std::min(y - statex[ch],10.0),-10.0);
-      // make_friendly_number_limited(statex[ch]);
-      ////vy[k] = statex[ch];
-      // vy[k] = y;
-    }
+  // the coefficients are updated only if the parameters changed:
+  if((f != f_used) || (q != q_used)) {
+    f_used = f;
+    q_used = q;
+    spk.set_resonance(f_used, q_used);
+  }
+  if(c != c_used) {
+    c_used = c;
+    spk.set_clipping(c_used);
+  }
+  if(g != g_used) {
+    g_used = g;
+    spk.set_gain(pow(10.0, 0.05 * g_used));
   }
+  spk.process(n, inBuf, outBuf);
   return 0;
 }
 
+void dc_t::print_load()
+{
+  std::cout << "oversampling " << spk.oversampling() << ", latency "
+            << spk.latency() << " samples, CPU load " << 100.0 * spk.cpu_load()
+            << "%" << std::endl;
+}
+
 static void sighandler(int sig)
 {
   b_quit = true;
@@ -126,13 +111,16 @@ int main(int argc, char** argv)
   float c(0.5);
   float fres(1200);
   float q(0.8);
+  uint32_t oversampling(1);
+  bool loadreport(false);
   std::vector<std::string> objnames;
-  const char* options = "hn:c:m:p:f:q:";
+  const char* options = "hn:c:m:p:f:q:o:l";
   struct option long_options[] = {
-      {"help", 0, 0, 'h'},      {"fres", 1, 0, 'f'},
-      {"q", 1, 0, 'q'},         {"scale", 1, 0, 'c'},
-      {"multicast", 1, 0, 'm'}, {"port", 1, 0, 'p'},
-      {"jackname", 1, 0, 'n'},  {0, 0, 0, 0}};
+      {"help", 0, 0, 'h'},         {"fres", 1, 0, 'f'},
+      {"q", 1, 0, 'q'},            {"scale", 1, 0, 'c'},
+      {"multicast", 1, 0, 'm'},    {"port", 1, 0, 'p'},
+      {"jackname", 1, 0, 'n'},     {"oversampling", 1, 0, 'o'},
+      {"loadreport", 0, 0, 'l'},   {0, 0, 0, 0}};
   int opt(0);
   int option_index(0);
   while((opt = getopt_long(argc, argv, options, long_options, &option_index)) !=
@@ -159,6 +147,12 @@ int main(int argc, char** argv)
     case 'n':
       jackname = optarg;
       break;
+    case 'o':
+      oversampling = atoi(optarg);
+      break;
+    case 'l':
+      loadreport = true;
+      break;
     }
   }
   while(optind < argc)
@@ -166,11 +160,17 @@ int main(int argc, char** argv)
   if(objnames.empty()) {
     objnames.push_back("0");
   }
-  dc_t dc(jackname, serveraddr, serverport, objnames, c, fres, q);
+  dc_t dc(jackname, serveraddr, serverport, objnames, c, fres, q,
+          oversampling);
   dc.jackc_t::activate();
   dc.osc_server_t::activate();
-  while(!b_quit)
+  uint32_t t(0);
+  while(!b_quit) {
     sleep(1);
+    // report CPU load every 5 seconds:
+    if(loadreport && ((++t % 5) == 0))
+      dc.print_load();
+  }
   dc.jackc_t::deactivate();
   dc.osc_server_t::deactivate();
   return 0;
@@ -26,7 +26,7 @@
 
 #include "hos_defs.h"
 #include "libhos_audiochunks.h"
-#include "libhos_random.h"
+#include "libhos_sustain.h"
 #include <getopt.h>
 #include <iostream>
 #include <math.h>
@@ -44,7 +44,7 @@ static bool b_quit;
 class sustain_t : public TASCAR::osc_server_t, public jackc_db_t {
 public:
   sustain_t(const std::string& server_addr, const std::string& server_port,
-            const std::string& name, uint32_t wlen);
+            const std::string& name, uint32_t wlen, uint32_t nlayers);
   virtual ~sustain_t();
   virtual int inner_process(jack_nframes_t, const std::vector<float*>&,
                             const std::vector<float*>&);
@@ -55,14 +55,14 @@ public:
   static int osc_apply(const char* path, const char* types, lo_arg** argv,
                        int argc, lo_message msg, void* user_data);
   void set_apply(float t);
+  static int osc_freeze(const char* path, const char* types, lo_arg** argv,
+                        int argc, lo_message msg, void* user_data);
+  static int osc_clear(const char* path, const char* types, lo_arg** argv,
+                       int argc, lo_message msg, void* user_data);
 
 protected:
   TASCAR::ola_t ola;
-  TASCAR::wave_t absspec;
-  float tau_sustain;
-  float tau_envelope;
-  double Lin;
-  double Lout;
+  HoS::sustain_spec_t sustain;
   float wet;
   uint32_t t_apply;
   float deltaw;
@@ -76,6 +76,26 @@ int sustain_t::osc_apply(const char* path, const char* types, lo_arg** argv,
   return 0;
 }
 
+int sustain_t::osc_freeze(const char* path, const char* types, lo_arg** argv,
+                          int argc, lo_message msg, void* user_data)
+{
+  sustain_t* self((sustain_t*)user_data);
+  if((argc == 1) && (types[0] == 'i') && (argv[0]->i >= 0) &&
+     ((uint32_t)(argv[0]->i) < self->sustain.layers.size()))
+    self->sustain.layers[argv[0]->i]->b_freeze = true;
+  return 0;
+}
+
+int sustain_t::osc_clear(const char* path, const char* types, lo_arg** argv,
+                         int argc, lo_message msg, void* user_data)
+{
+  sustain_t* self((sustain_t*)user_data);
+  if((argc == 1) && (types[0] == 'i') && (argv[0]->i >= 0) &&
+     ((uint32_t)(argv[0]->i) < self->sustain.layers.size()))
+    self->sustain.layers[argv[0]->i]->b_clear = true;
+  return 0;
+}
+
 void sustain_t::set_apply(float t)
 {
   deltaw = 0;
@@ -91,69 +111,55 @@ int sustain_t::process(jack_nframes_t n, const std::vector<float*>& vIn,
                        const std::vector<float*>& vOut)
 {
   jackc_db_t::process(n, vIn, vOut);
-  TASCAR::wave_t w_in(n, vIn[0]);
-  TASCAR::wave_t w_out(n, vOut[0]);
-  float env_c1(0);
-  if(tau_envelope > 0)
-    env_c1 = exp(-1.0 / (tau_envelope * (double)srate));
-  float env_c2(1.0f - env_c1);
-  // envelope reconstruction:
-  for(uint32_t k = 0; k < w_in.size(); ++k) {
-    Lin *= env_c1;
-    Lin += env_c2 * w_in[k] * w_in[k];
-    Lout *= env_c1;
-    Lout += env_c2 * w_out[k] * w_out[k];
-    if(Lout > 0)
-      w_out[k] *= sqrt(Lin / Lout);
-    if(t_apply) {
-      t_apply--;
-      currentw += deltaw;
-    }
-    w_out[k] *= currentw;
-    w_out[k] += (1.0f - currentw) * w_in[k];
+  // cross fade between wet and dry signal:
+  uint32_t nramp(std::min(t_apply, (uint32_t)n));
+  float* vin(vIn[0]);
+  float* vout(vOut[0]);
+  for(uint32_t k = 0; k < n; ++k) {
+    float w(currentw + deltaw * (float)std::min(k + 1, nramp));
+    vout[k] = w * vout[k] + (1.0f - w) * vin[k];
   }
+  currentw += deltaw * (float)nramp;
+  t_apply -= nramp;
   return 0;
 }
 
-std::complex<float> If = 1i;
-
 int sustain_t::inner_process(jack_nframes_t n, const std::vector<float*>& vIn,
                              const std::vector<float*>& vOut)
 {
   TASCAR::wave_t w_in(n, vIn[0]);
   TASCAR::wave_t w_out(n, vOut[0]);
   ola.process(w_in);
-  float sus_c1(0);
-  if(tau_sustain > 0)
-    sus_c1 = exp(-1.0 / (tau_sustain * (double)srate / (double)(w_in.size())));
-  float sus_c2(1.0f - sus_c1);
-  ola.s *= sus_c2;
-  absspec *= sus_c1;
-  for(uint32_t k = 0; k < ola.s.size(); k++) {
-    absspec[k] += std::abs(ola.s[k]);
-    ola.s[k] = absspec[k] * std::exp(If * (float)(drand() * PI2));
-  }
+  sustain.process(ola.s);
   ola.ifft(w_out);
   return 0;
 }
 
 sustain_t::sustain_t(const std::string& server_addr,
                      const std::string& server_port, const std::string& name,
-                     uint32_t wlen)
+                     uint32_t wlen, uint32_t nlayers)
     : osc_server_t(server_addr, server_port, "UDP"), jackc_db_t(name, wlen),
       // doublebuffer_t(4*wlen,wlen),
       ola(2 * wlen, 2 * wlen, wlen, TASCAR::stft_t::WND_HANNING,
           TASCAR::stft_t::WND_RECT, 0.5, TASCAR::stft_t::WND_SQRTHANN),
-      absspec(ola.s.size()), tau_sustain(20), tau_envelope(1), Lin(0), Lout(0),
-      wet(1.0f), t_apply(0), deltaw(0), currentw(0)
+      sustain(ola.s.size(), nlayers, (double)srate / (double)wlen), wet(1.0f),
+      t_apply(0), deltaw(0), currentw(0)
 {
   set_prefix("/" + name);
   add_input_port("in");
   add_output_port("out");
-  add_float("/tau_sus", &tau_sustain);
-  add_float("/tau_env", &tau_envelope);
+  add_float("/tau_sus", &(sustain.tau_sustain));
+  add_float("/tau_env", &(sustain.tau_envelope));
   add_float("/wet", &wet);
   add_method("/wetapply", "f", &sustain_t::osc_apply, this);
+  add_float("/live", &(sustain.livegain));
+  add_method("/freeze", "i", &sustain_t::osc_freeze, this);
+  add_method("/clear", "i", &sustain_t::osc_clear, this);
+  for(uint32_t k = 0; k < sustain.layers.size(); ++k) {
+    std::string pref("/layer/" + std::to_string(k));
+    add_float(pref + "/gain", &(sustain.layers[k]->gain));
+    add_float(pref + "/tau", &(sustain.layers[k]->tau));
+  }
 }
 
 void sustain_t::activate()
@@ -209,10 +215,12 @@ int main(int argc, char** argv)
   std::string serverport("6978");
   std::string serveraddr("239.255.1.7");
   uint32_t wlen(8192);
-  const char* options = "hn:p:m:w:";
+  uint32_t nlayers(8);
+  const char* options = "hn:p:m:w:l:";
   struct option long_options[] = {{"help", 0, 0, 'h'}, {"multicast", 1, 0, 'm'},
                                   {"port", 1, 0, 'p'}, {"jackname", 1, 0, 'n'},
-                                  {"wlen", 1, 0, 'w'}, {0, 0, 0, 0}};
+                                  {"wlen", 1, 0, 'w'}, {"layers", 1, 0, 'l'},
+                                  {0, 0, 0, 0}};
   int opt(0);
   int option_index(0);
   while((opt = getopt_long(argc, argv, options, long_options, &option_index)) !=
@@ -233,9 +241,12 @@ int main(int argc, char** argv)
     case 'n':
       jackname = optarg;
       break;
+    case 'l':
+      nlayers = atoi(optarg);
+      break;
     }
   }
-  sustain_t c(serveraddr, serverport, jackname, wlen);
+  sustain_t c(serveraddr, serverport, jackname, wlen, nlayers);
   c.activate();
   while(!b_quit)
     sleep(1);
@@ -0,0 +1,224 @@
+#include "libhos_filterbank.h"
+#include <algorithm>
+#include <math.h>
+#include <tascar/errorhandling.h>
+
+using namespace HoS;
+
+// number of samples processed at once by gammatone_bank_t:
+#define GT_CHUNK 64
+
+float HoS::erb(float f)
+{
+  return 24.7f + f / 9.265f;
+}
+
+std::vector<float> HoS::logfreqs(float fmin, float fmax, float bpo)
+{
+  std::vector<float> f;
+  if((fmin <= 0) || (bpo <= 0))
+    throw TASCAR::ErrMsg("Invalid parameters of logarithmic frequency scale.");
+  for(uint32_t k = 0; fmin * powf(2.0f, k / bpo) <= fmax; ++k)
+    f.push_back(fmin * powf(2.0f, k / bpo));
+  return f;
+}
+
+bandmode_t HoS::parse_bandmode(const std::string& name)
+{
+  if(name == "fft")
+    return BANDS_FFT;
+  if(name == "constq")
+    return BANDS_CONSTQ;
+  if(name == "gammatone")
+    return BANDS_GAMMATONE;
+  throw TASCAR::ErrMsg("Invalid band mode \"" + name +
+                       "\" (valid: fft, constq, gammatone).");
+}
+
+gammatone_bank_t::gammatone_bank_t(const std::vector<float>& f,
+                                   const std::vector<float>& bw, double fs,
+                                   uint32_t order_)
+    : fc(f), power(f.size()), order(order_), nbands(f.size()), a_re(nbands),
+      a_im(nbands), b(nbands), s_re(order * nbands, 0.0f),
+      s_im(order * nbands, 0.0f), y_re(GT_CHUNK * nbands),
+      y_im(GT_CHUNK * nbands)
+{
+  if(bw.size() != f.size())
+    throw TASCAR::ErrMsg("Number of bandwidths does not match number of "
+                         "center frequencies.");
+  if(order == 0)
+    throw TASCAR::ErrMsg("Invalid gammatone filter order.");
+  for(uint32_t k = 0; k < nbands; ++k) {
+    // pole radius for -3 dB at the band edges of the cascade:
+    double u(pow(2.0, -1.0 / order));
+    double ct(cos(M_PI * bw[k] / fs));
+    double ct2(ct * ct);
+    double lambda(
+        (sqrt((ct2 - 1.0) * u * u + (2.0 - 2.0 * ct) * u) + ct * u - 1.0) /
+        (u - 1.0));
+    a_re[k] = lambda * cos(2.0 * M_PI * f[k] / fs);
+    a_im[k] = lambda * sin(2.0 * M_PI * f[k] / fs);
+    b[k] = pow(2.0, 1.0 / order) * (1.0 - lambda);
+  }
+}
+
+/**
+   \brief Filter up to GT_CHUNK samples, the output is stored in y_re
+   and y_im
+ */
+void gammatone_bank_t::filter_chunk(const float* in, uint32_t n)
+{
+  const uint32_t N(nbands);
+  const float* ar(a_re.data());
+  const float* ai(a_im.data());
+  const float* bb(b.data());
+  float* yr(y_re.data());
+  float* yi(y_im.data());
+  for(uint32_t t = 0; t < n; ++t) {
+    const float x(in[t]);
+    // first stage, real input:
+    float* sr(s_re.data());
+    float* si(s_im.data());
+    for(uint32_t k = 0; k < N; ++k) {
+      float r(ar[k] * sr[k] - ai[k] * si[k] + bb[k] * x);
+      float i(ar[k] * si[k] + ai[k] * sr[k]);
+      sr[k] = r;
+      si[k] = i;
+    }
+    // further stages, input is output of previous stage:
+    for(uint32_t o = 1; o < order; ++o) {
+      const float* xr(sr);
+      const float* xi(si);
+      sr += N;
+      si += N;
+      for(uint32_t k = 0; k < N; ++k) {
+        float r(ar[k] * sr[k] - ai[k] * si[k] + bb[k] * xr[k]);
+        float i(ar[k] * si[k] + ai[k] * sr[k] + bb[k] * xi[k]);
+        sr[k] = r;
+        si[k] = i;
+      }
+    }
+    for(uint32_t k = 0; k < N; ++k) {
+      yr[k] = sr[k];
+      yi[k] = si[k];
+    }
+    yr += N;
+    yi += N;
+  }
+}
+
+void gammatone_bank_t::process(const TASCAR::wave_t& in)
+{
+  const uint32_t N(nbands);
+  float* pw(power.d);
+  for(uint32_t k = 0; k < N; ++k)
+    pw[k] = 0.0f;
+  for(uint32_t t0 = 0; t0 < in.n; t0 += GT_CHUNK) {
+    uint32_t n(std::min((uint32_t)GT_CHUNK, in.n - t0));
+    filter_chunk(&(in.d[t0]), n);
+    const float* yr(y_re.data());
+    const float* yi(y_im.data());
+    for(uint32_t t = 0; t < n; ++t) {
+      for(uint32_t k = 0; k < N; ++k)
+        pw[k] += yr[k] * yr[k] + yi[k] * yi[k];
+      yr += N;
+      yi += N;
+    }
+  }
+  if(in.n)
+    for(uint32_t k = 0; k < N; ++k)
+      pw[k] /= (float)(in.n);
+}
+
+void gammatone_bank_t::process(const float* in, uint32_t n, float** out,
+                               float** out_im)
+{
+  for(uint32_t t0 = 0; t0 < n; t0 += GT_CHUNK) {
+    uint32_t nc(std::min((uint32_t)GT_CHUNK, n - t0));
+    filter_chunk(&(in[t0]), nc);
+    for(uint32_t k = 0; k < nbands; ++k) {
+      const float* yr(&(y_re[k]));
+      float* o(&(out[k][t0]));
+      for(uint32_t t = 0; t < nc; ++t)
+        o[t] = yr[t * nbands];
+    }
+    if(out_im)
+      for(uint32_t k = 0; k < nbands; ++k) {
+        const float* yi(&(y_im[k]));
+        float* o(&(out_im[k][t0]));
+        for(uint32_t t = 0; t < nc; ++t)
+          o[t] = yi[t * nbands];
+      }
+  }
+}
+
+constq_t::constq_t(uint32_t fftlen, double fs, float fmin, float fmax,
+                   float bpo)
+    : constq_t(fftlen, fs, logfreqs(fmin, fmax, bpo), bpo)
+{
+}
+
+constq_t::constq_t(uint32_t fftlen, double fs, const std::vector<float>& f_,
+                   float bpo)
+    : fc(f_), power(fc.size())
+{
+  if(bpo <= 0)
+    throw TASCAR::ErrMsg("Invalid number of bands per octave.");
+  const uint32_t nbins(fftlen / 2 + 1);
+  const double df(fs / fftlen);
+  for(auto f : fc) {
+    wstart.push_back(weights.size());
+    // bins within one band distance below and above the center:
+    uint32_t k0(std::min(nbins - 1, (uint32_t)ceil(f * pow(2.0, -1.0 / bpo) /
+                                                   df)));
+    uint32_t k1(std::min(nbins - 1, (uint32_t)floor(f * pow(2.0, 1.0 / bpo) /
+                                                    df)));
+    k0 = std::max(1u, k0);
+    std::vector<float> w;
+    double wsum(0.0);
+    for(uint32_t k = k0; k <= k1; ++k) {
+      double v(std::max(0.0, 1.0 - fabs(log2(k * df / f)) * bpo));
+      w.push_back(v);
+      wsum += v;
+    }
+    if(wsum <= 0.0) {
+      // band is narrower than the bin spacing, interpolate linearly
+      // between the two nearest bins:
+      double p(std::min((double)(nbins - 1), f / df));
+      uint32_t kl(std::min(nbins - 2, (uint32_t)p));
+      w.clear();
+      w.push_back(1.0 - (p - kl));
+      w.push_back(p - kl);
+      wsum = 1.0;
+      k0 = kl;
+    }
+    for(auto v : w)
+      weights.push_back(v / wsum);
+    kstart.push_back(k0);
+    kend.push_back(k0 + w.size());
+  }
+}
+
+void constq_t::process(const TASCAR::spec_t& X)
+{
+  const float* x((const float*)(X.b));
+  for(uint32_t band = 0; band < fc.size(); ++band) {
+    const float* w(&(weights[wstart[band]]));
+    float p(0.0f);
+    const uint32_t k1(std::min(kend[band], X.n_));
+    for(uint32_t k = kstart[band]; k < k1; ++k) {
+      p += (*w) * (x[2 * k] * x[2 * k] + x[2 * k + 1] * x[2 * k + 1]);
+      ++w;
+    }
+    power.d[band] = p;
+  }
+}
+
+/*
+ * Local Variables:
+ * mode: c++
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * compile-command: "make -C .."
+ * End:
+ */
@@ -0,0 +1,193 @@
+/**
+   \file libhos_filterbank.h
+   \brief Filterbanks with logarithmic frequency resolution
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; version 2
+   of the License.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+   USA.
+
+*/
+#ifndef LIBHOS_FILTERBANK_H
+#define LIBHOS_FILTERBANK_H
+
+#include <stdint.h>
+#include <string>
+#include <tascar/audiochunks.h>
+#include <vector>
+
+namespace HoS {
+
+  /**
+     \brief Frequency analysis of the tools which use the filterbanks
+   */
+  enum bandmode_t {
+    /// FFT bins, mapped to bands by the tool:
+    BANDS_FFT,
+    /// Constant-Q bands from the STFT, see constq_t:
+    BANDS_CONSTQ,
+    /// Gammatone filterbank in the time domain, see gammatone_bank_t:
+    BANDS_GAMMATONE
+  };
+
+  /**
+     \brief Parse the name of a band mode
+     \param name One of "fft", "constq" or "gammatone"
+   */
+  bandmode_t parse_bandmode(const std::string& name);
+
+  /**
+     \brief Equivalent rectangular bandwidth (Glasberg and Moore, 1990)
+     \param f Frequency in Hz
+     \return Bandwidth in Hz
+   */
+  float erb(float f);
+
+  /**
+     \brief Logarithmically spaced center frequencies
+     \param fmin Lowest frequency in Hz
+     \param fmax Highest frequency in Hz
+     \param bpo Bands per octave
+   */
+  std::vector<float> logfreqs(float fmin, float fmax, float bpo);
+
+  /**
+     \brief Bank of complex gammatone filters
+
+     Filter design after V. Hohmann (2002). Frequency analysis and
+     synthesis using a Gammatone filterbank. Acta Acustica united with
+     Acustica vol. 88.
+
+     The filter coefficients and states of all bands are stored in
+     separate real and imaginary arrays, and the inner loops run
+     across bands, so that several bands are processed in parallel in
+     the SIMD lanes. Blocks are processed in chunks of fixed size, so
+     that no memory is allocated during processing. The time
+     resolution of low bands is determined by their bandwidth only,
+     i.e., pitch resolved analysis at low frequencies does not require
+     long FFTs.
+   */
+  class gammatone_bank_t {
+  public:
+    /**
+       \param f Center frequencies in Hz
+       \param bw Bandwidths in Hz, one for each center frequency
+       \param fs Sampling rate in Hz
+       \param order Filter order
+    */
+    gammatone_bank_t(const std::vector<float>& f, const std::vector<float>& bw,
+                     double fs, uint32_t order = 4);
+    /**
+       \brief Filter a block and compute the mean power of each band
+    */
+    void process(const TASCAR::wave_t& in);
+    /**
+       \brief Filter a block and return the band signals
+       \param in Input signal
+       \param n Number of samples
+       \param out Real part of the output, one array of n samples for
+       each band
+       \param out_im Imaginary part of the output, or NULL
+    */
+    void process(const float* in, uint32_t n, float** out,
+                 float** out_im = NULL);
+    /// Number of bands:
+    uint32_t size() const { return fc.size(); };
+    /// Center frequencies in Hz:
+    std::vector<float> fc;
+    /// Mean power of each band in the last block:
+    TASCAR::wave_t power;
+
+  private:
+    void filter_chunk(const float* in, uint32_t n);
+    uint32_t order;
+    uint32_t nbands;
+    std::vector<float> a_re;
+    std::vector<float> a_im;
+    std::vector<float> b;
+    // states, stage by stage:
+    std::vector<float> s_re;
+    std::vector<float> s_im;
+    // output of last chunk, sample by sample:
+    std::vector<float> y_re;
+    std::vector<float> y_im;
+  };
+
+  /**
+     \brief Constant-Q band powers from an STFT
+
+     Each band is a triangular window on a logarithmic frequency axis,
+     which spans from the center frequency of the lower neighbour band
+     to the center frequency of the upper neighbour band. The kernel
+     is sparse and precomputed, so the mapping costs one multiply-add
+     per non-zero kernel element. Bands which are narrower than the
+     FFT bin spacing are interpolated from the two nearest bins.
+   */
+  class constq_t {
+  public:
+    /**
+       \param fftlen FFT length of the STFT
+       \param fs Sampling rate in Hz
+       \param fmin Center frequency of lowest band in Hz
+       \param fmax Upper limit of center frequencies in Hz
+       \param bpo Bands per octave
+    */
+    constq_t(uint32_t fftlen, double fs, float fmin, float fmax, float bpo);
+    /**
+       \param fftlen FFT length of the STFT
+       \param fs Sampling rate in Hz
+       \param f Center frequencies in Hz, logarithmically spaced
+       \param bpo Bands per octave, determines the kernel width
+    */
+    constq_t(uint32_t fftlen, double fs, const std::vector<float>& f,
+             float bpo);
+    /**
+       \brief Compute band powers of a spectrum
+       \param X Spectrum, with fftlen/2+1 bins
+    */
+    void process(const TASCAR::spec_t& X);
+    /// Number of bands:
+    uint32_t size() const { return fc.size(); };
+    /// Center frequencies in Hz:
+    std::vector<float> fc;
+    /// Power of each band, normalized by the sum of kernel weights:
+    TASCAR::wave_t power;
+    /// First bin of the kernel of a band:
+    uint32_t bin_start(uint32_t band) const { return kstart[band]; };
+    /// One past the last bin of the kernel of a band:
+    uint32_t bin_end(uint32_t band) const { return kend[band]; };
+    /// Normalized kernel weights of a band, from bin_start to bin_end:
+    const float* kernel(uint32_t band) const
+    {
+      return &(weights[wstart[band]]);
+    };
+
+  private:
+    std::vector<uint32_t> kstart;
+    std::vector<uint32_t> kend;
+    std::vector<uint32_t> wstart;
+    std::vector<float> weights;
+  };
+
+} // namespace HoS
+
+#endif
+
+/*
+ * Local Variables:
+ * mode: c++
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * compile-command: "make -C .."
+ * End:
+ */
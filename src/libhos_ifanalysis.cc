@@ -0,0 +1,68 @@
+#include "libhos_ifanalysis.h"
+#include <algorithm>
+#include <math.h>
+
+using namespace HoS;
+
+if_analysis_t::if_analysis_t(uint32_t fftlen, uint32_t wndlen,
+                             uint32_t chunksize, double srate, bool stats)
+    : ifreq(fftlen / 2 + 1), mag(fftlen / 2 + 1), ifmean(fftlen / 2 + 1),
+      ifstd(fftlen / 2 + 1), d1(chunksize),
+      dtfft(fftlen, wndlen, chunksize, TASCAR::stft_t::WND_HANNING, 0.5),
+      x_re(fftlen / 2 + 1), x_im(fftlen / 2 + 1), ifvar(fftlen / 2 + 1),
+      ifscale(srate / (2.0 * M_PI)), framerate(srate / chunksize), c1(0.0f),
+      b_stats(stats)
+{
+}
+
+void if_analysis_t::set_tau(float tau)
+{
+  if(tau > 0.0f)
+    c1 = expf(-1.0f / (tau * framerate));
+  else
+    c1 = 0.0f;
+}
+
+void if_analysis_t::process(const TASCAR::wave_t& w, const TASCAR::spec_t& X)
+{
+  d1.process(w);
+  dtfft.process(d1);
+  const uint32_t N(std::min(X.n_, ifreq.n));
+  // complex spectra are stored interleaved (re,im):
+  const float* xc((const float*)(X.b));
+  const float* xd((const float*)(dtfft.s.b));
+  float* re(x_re.d);
+  float* im(x_im.d);
+  // cross spectrum X * conj(Xd):
+  for(uint32_t k = 0; k < N; ++k) {
+    re[k] = xc[2 * k] * xd[2 * k] + xc[2 * k + 1] * xd[2 * k + 1];
+    im[k] = xc[2 * k + 1] * xd[2 * k] - xc[2 * k] * xd[2 * k + 1];
+  }
+  float* f(ifreq.d);
+  float* m(mag.d);
+  for(uint32_t k = 0; k < N; ++k) {
+    f[k] = fast_atan2f(im[k], re[k]) * ifscale;
+    m[k] = sqrtf(re[k] * re[k] + im[k] * im[k]);
+  }
+  if(!b_stats)
+    return;
+  const float c2(1.0f - c1);
+  float* fm(ifmean.d);
+  float* fv(ifvar.d);
+  float* fs(ifstd.d);
+  for(uint32_t k = 0; k < N; ++k) {
+    fm[k] = c1 * fm[k] + c2 * f[k];
+    float diff(fm[k] - f[k]);
+    fv[k] = c1 * fv[k] + c2 * diff * diff;
+    fs[k] = sqrtf(std::max(0.0f, fv[k]));
+  }
+}
+
+/*
+ * Local Variables:
+ * mode: c++
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * compile-command: "make -C .."
+ * End:
+ */
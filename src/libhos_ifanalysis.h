@@ -0,0 +1,100 @@
+/**
+   \file libhos_ifanalysis.h
+   \brief Instantaneous frequency analysis
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; version 2
+   of the License.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+   USA.
+
+*/
+#ifndef LIBHOS_IFANALYSIS_H
+#define LIBHOS_IFANALYSIS_H
+
+#include "fastmath.h"
+#include "libhos_audiochunks.h"
+#include <tascar/stft.h>
+
+namespace HoS {
+
+  /**
+     \brief Instantaneous frequency analysis
+
+     The instantaneous frequency of each STFT bin is estimated from
+     the phase difference between the spectrum of the current block
+     and the spectrum of the same signal delayed by one sample. The
+     spectrum of the current block is provided by the caller, e.g., by
+     an overlap-add object which is later used for resynthesis, so
+     that only the delayed signal needs an additional STFT.
+
+     Optionally, mean and standard deviation of the instantaneous
+     frequency of each bin are tracked with first order low pass
+     filters.
+
+     All results are stored per bin in separate arrays, so that the
+     analysis loops can be vectorized.
+   */
+  class if_analysis_t {
+  public:
+    /**
+       \param fftlen FFT length
+       \param wndlen Window length
+       \param chunksize Block size
+       \param srate Sampling rate in Hz
+       \param stats Estimate mean and standard deviation
+    */
+    if_analysis_t(uint32_t fftlen, uint32_t wndlen, uint32_t chunksize,
+                  double srate, bool stats = true);
+    /**
+       \brief Set time constant of mean and variance estimation
+       \param tau Time constant in seconds
+    */
+    void set_tau(float tau);
+    /**
+       \brief Analyse one block
+       \param w Input signal of current block
+       \param X Spectrum of current block, using the same STFT
+       parameters as this analysis
+    */
+    void process(const TASCAR::wave_t& w, const TASCAR::spec_t& X);
+    /// Number of bins:
+    uint32_t size() const { return ifreq.n; };
+    TASCAR::wave_t ifreq;  ///< Instantaneous frequency in Hz
+    TASCAR::wave_t mag;    ///< Magnitude of cross spectrum
+    TASCAR::wave_t ifmean; ///< Low pass filtered instantaneous frequency
+    TASCAR::wave_t ifstd;  ///< Standard deviation of instantaneous frequency
+
+  private:
+    delay1_t d1;
+    TASCAR::stft_t dtfft;
+    TASCAR::wave_t x_re;
+    TASCAR::wave_t x_im;
+    TASCAR::wave_t ifvar;
+    float ifscale;
+    float framerate;
+    float c1;
+    bool b_stats;
+  };
+
+} // namespace HoS
+
+#endif
+
+/*
+ * Local Variables:
+ * mode: c++
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * compile-command: "make -C .."
+ * End:
+ */
@@ -8,6 +8,7 @@
 
 #include <iostream>
 #include <map>
+#include <stdint.h>
 
 /**
    \brief Return randum number between 0 (included) and 1 (excluded)
@@ -15,6 +16,29 @@
  */
 double drand();
 
+/**
+   \brief Fast pseudo random number generator (xorshift32)
+   \ingroup rtm
+
+   Suitable for real-time use; not thread safe, use one instance per
+   thread.
+ */
+class xorshift_t {
+public:
+  xorshift_t(uint32_t seed = 2463534242u) : state(seed ? seed : 1u){};
+  /// Return random number in the range [1,2^32-1]:
+  uint32_t operator()()
+  {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+  };
+
+private:
+  uint32_t state;
+};
+
 /**
    \brief Gauss function with mean=0 and variance sigma
    \ingroup rtm
@@ -31,9 +31,6 @@
 #include <iostream>
 #include <math.h>
 
-//#define OSC_ADDR "239.255.1.7"
-#define OSC_ADDR "239.255.1.7"
-#define OSC_PORT "6978"
 #define OSC_FBPORT "6978"
 
 using namespace HoS;
@@ -265,10 +262,10 @@ void parameter_t::apply(float time)
   b_applyat = false;
 }
 
-parameter_t::parameter_t(const std::string& name)
-    : TASCAR::osc_server_t(OSC_ADDR, OSC_PORT, "UDP"), stopat(0),
-      b_stopat(false), applyat(0), applyat_time(0), b_applyat(false),
-      lo_addr(lo_address_new(OSC_ADDR, OSC_FBPORT)), b_quit(false), f_update(1),
+parameter_t::parameter_t(TASCAR::osc_server_t& srv, const std::string& name)
+    : stopat(0), b_stopat(false), applyat(0), applyat_time(0),
+      b_applyat(false), lo_addr(lo_address_new(SPHERE_OSC_ADDR, OSC_FBPORT)),
+      b_quit(false), f_update(1),
       t_locate(0), t_elev(0), t_apply(0), lastphi(0),
       osc_prefix(std::string("/") + name + std::string("/"))
 {
@@ -277,8 +274,7 @@ parameter_t::parameter_t(const std::string& name)
   std::string s;
   // lost =
   // lo_server_thread_new_multicast(OSC_ADDR,OSC_PORT,OSC::lo_err_handler_cb);
-  set_prefix(osc_prefix);
-  add_bool_true("quit", &b_quit);
+  srv.add_bool_true(osc_prefix + "quit", &b_quit);
 //#define REGISTER_FLOAT_VAR(x) s =
 // osc_prefix+#x;lo_server_thread_add_method(lost,s.c_str(),"f",OSC::handler_f,&(par_osc.x))
 //#define REGISTER_FLOAT_VAR_DEGREE(x) s =
@@ -286,10 +282,11 @@ parameter_t::parameter_t(const std::string& name)
 //#define REGISTER_CALLBACK(x,fmt)
 // s=osc_prefix+#x;lo_server_thread_add_method(lost,s.c_str(),fmt,OSC::_ ##
 // x,this)
-#define REGISTER_FLOAT_VAR(x) add_float(#x, &(par_osc.x))
+#define REGISTER_FLOAT_VAR(x) srv.add_float(osc_prefix + #x, &(par_osc.x))
 #define REGISTER_FLOAT_VAR_DEGREE(x)                                           \
-  add_method(#x, "f", OSC::handler_angle_f, &(par_osc.x))
-#define REGISTER_CALLBACK(x, fmt) add_method(#x, fmt, OSC::_##x, this)
+  srv.add_method(osc_prefix + #x, "f", OSC::handler_angle_f, &(par_osc.x))
+#define REGISTER_CALLBACK(x, fmt)                                              \
+  srv.add_method(osc_prefix + #x, fmt, OSC::_##x, this)
   REGISTER_FLOAT_VAR_DEGREE(phi0);
   REGISTER_FLOAT_VAR_DEGREE(elev);
   REGISTER_FLOAT_VAR_DEGREE(rvbelev);
@@ -321,7 +318,6 @@ parameter_t::parameter_t(const std::string& name)
 #undef REGISTER_FLOAT_VAR
 #undef REGISTER_CALLBACK
   // lo_server_thread_start(lost);
-  activate();
   // set_feedback_osc_addr( OSC_ADDR );
 }
 
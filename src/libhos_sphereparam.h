@@ -32,6 +32,10 @@
 #include <tascar/defs.h>
 #include <tascar/osc_helper.h>
 
+/// Multicast address and port of the OSC control of all sources:
+#define SPHERE_OSC_ADDR "239.255.1.7"
+#define SPHERE_OSC_PORT "6978"
+
 /**
 \brief Classes mainly used for artistic purposes
 
@@ -67,9 +71,16 @@ namespace HoS {
     float map_f;      // frequency in Hz
   };
 
-  class parameter_t : public TASCAR::osc_server_t {
+  /**
+     \brief Trajectory parameters of one source
+
+     The OSC methods are registered under the prefix "/<name>/" on an
+     OSC server owned by the client, so that several sources share one
+     server and one receiver thread.
+   */
+  class parameter_t {
   public:
-    parameter_t(const std::string& name);
+    parameter_t(TASCAR::osc_server_t& srv, const std::string& name);
     ~parameter_t();
     // void set_preset();
     void locate0(float time);
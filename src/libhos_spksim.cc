@@ -0,0 +1,300 @@
+#include "libhos_spksim.h"
+#include <algorithm>
+#include <chrono>
+#include <complex>
+#include <math.h>
+#include <string.h>
+#include <tascar/errorhandling.h>
+
+using namespace HoS;
+
+// number of samples processed at once by spksim_t:
+#define SPKSIM_CHUNK 64
+// number of channels is padded to a multiple of this:
+#define SPKSIM_LANES 8
+// number of state arrays:
+#define SPKSIM_NSTATE 5
+// limit of input and resonance filter output:
+#define SPKSIM_LIMIT 1.0e10f
+
+/*
+  Modified Bessel function of first kind and order zero, for the Kaiser
+  window.
+*/
+static double bessel_i0(double x)
+{
+  double s(1.0);
+  double t(1.0);
+  for(uint32_t k = 1; k < 32; ++k) {
+    t *= (0.5 * x / k) * (0.5 * x / k);
+    s += t;
+  }
+  return s;
+}
+
+halfband_t::halfband_t(uint32_t lanes, uint32_t maxlen, uint32_t P_,
+                       double beta)
+    : nl(lanes), P(P_), c(2 * P, 0.0f), x_up((2 * P - 1 + maxlen) * nl, 0.0f),
+      x_down((4 * P - 2 + 2 * maxlen) * nl, 0.0f)
+{
+  if(P == 0)
+    throw TASCAR::ErrMsg("Invalid halfband filter length.");
+  // non-zero taps at odd offsets j from the center, normalized to a
+  // gain of one at zero frequency:
+  const double D(2 * P - 1);
+  double sum(0.0);
+  for(uint32_t k = 0; k < 2 * P; ++k) {
+    double j(2.0 * k - D);
+    double w(bessel_i0(beta * sqrt(1.0 - (j / D) * (j / D))) /
+             bessel_i0(beta));
+    double h(sin(0.5 * M_PI * j) / (M_PI * j) * w);
+    c[k] = h;
+    sum += h;
+  }
+  for(auto& v : c)
+    v /= sum;
+}
+
+/*
+  Inner loops of the halfband filter. x and v point to the first new
+  sample, the history is stored in front of it.
+*/
+static void halfband_up(const float* __restrict__ x, uint32_t n, uint32_t nl,
+                        uint32_t P, const float* __restrict__ c,
+                        float* __restrict__ y)
+{
+  for(uint32_t t = 0; t < n; ++t) {
+    const float* xt(x + t * nl);
+    float* ye(y + 2 * t * nl);
+    float* yo(ye + nl);
+    // odd phase is the center tap:
+    const float* xc(xt - (P - 1) * nl);
+    for(uint32_t l = 0; l < nl; ++l) {
+      ye[l] = 0.0f;
+      yo[l] = xc[l];
+    }
+    for(uint32_t k = 0; k < 2 * P; ++k) {
+      const float* xk(xt - k * nl);
+      const float ck(c[k]);
+      for(uint32_t l = 0; l < nl; ++l)
+        ye[l] += ck * xk[l];
+    }
+  }
+}
+
+static void halfband_down(const float* __restrict__ v, uint32_t n,
+                          uint32_t nl, uint32_t P, const float* __restrict__ c,
+                          float* __restrict__ z)
+{
+  for(uint32_t t = 0; t < n; ++t) {
+    const float* vt(v + 2 * t * nl);
+    float* zt(z + t * nl);
+    const float* vc(vt - (2 * P - 1) * nl);
+    for(uint32_t l = 0; l < nl; ++l)
+      zt[l] = 0.5f * vc[l];
+    for(uint32_t k = 0; k < 2 * P; ++k) {
+      const float* vk(vt - 2 * k * nl);
+      const float ck(0.5f * c[k]);
+      for(uint32_t l = 0; l < nl; ++l)
+        zt[l] += ck * vk[l];
+    }
+  }
+}
+
+void halfband_t::upsample(const float* in, uint32_t n, float* out)
+{
+  const uint32_t hist((2 * P - 1) * nl);
+  float* x(&(x_up[hist]));
+  memcpy(x, in, n * nl * sizeof(float));
+  halfband_up(x, n, nl, P, c.data(), out);
+  memmove(x_up.data(), &(x_up[n * nl]), hist * sizeof(float));
+}
+
+void halfband_t::downsample(const float* in, uint32_t n, float* out)
+{
+  const uint32_t hist((4 * P - 2) * nl);
+  float* v(&(x_down[hist]));
+  memcpy(v, in, 2 * n * nl * sizeof(float));
+  halfband_down(v, n, nl, P, c.data(), out);
+  memmove(x_down.data(), &(x_down[2 * n * nl]), hist * sizeof(float));
+}
+
+spksim_t::spksim_t(uint32_t channels, double fs, uint32_t oversampling)
+    : fs_(fs), nch(channels),
+      nl(SPKSIM_LANES * ((channels + SPKSIM_LANES - 1) / SPKSIM_LANES)),
+      d_pre(0.0f), a(1.0f), b1(0.0f), b2(0.0f), c(1.0f), lp1(0.0f), lp2(1.0f),
+      d_post(0.0f), g(1.0f), state(SPKSIM_NSTATE * nl, 0.0f),
+      buf(SPKSIM_CHUNK * nl, 0.0f), latency_(0.0), t_proc(0), n_proc(0)
+{
+  if((oversampling != 1) && (oversampling != 2) && (oversampling != 4))
+    throw TASCAR::ErrMsg("Invalid oversampling factor (must be 1, 2 or 4).");
+  // the second stage runs on a signal which is already band limited,
+  // and needs a shorter filter:
+  const uint32_t P[2] = {12, 6};
+  for(uint32_t k = 0; (1u << (k + 1)) <= oversampling; ++k) {
+    halfbands.push_back(halfband_t(nl, SPKSIM_CHUNK << k, P[k], 7.0));
+    latency_ += (2.0 * P[k] - 1.0) / (1u << k);
+  }
+  for(uint32_t k = 0; k < halfbands.size(); ++k)
+    buf_os.push_back(aligned_vector_t((2u << k) * SPKSIM_CHUNK * nl, 0.0f));
+}
+
+void spksim_t::set_resonance(double f, double q)
+{
+  const double w(2.0 * M_PI * f / fs_);
+  // gain normalization: distance of the pole from the unit circle at the
+  // resonance frequency
+  std::complex<double> z(std::polar(1.0, w));
+  std::complex<double> z0(std::polar(q, -w));
+  a = (1.0 - q) * std::abs(z - z0);
+  b1 = 2.0 * q * cos(w);
+  b2 = -q * q;
+}
+
+void spksim_t::set_lowpass(double fcut)
+{
+  if(fcut > 0) {
+    lp1 = exp(-fcut / fs_);
+    lp2 = 1.0 - lp1;
+  } else {
+    lp1 = 0.0f;
+    lp2 = 1.0f;
+  }
+}
+
+void spksim_t::set_differentiator(bool pre, bool post)
+{
+  d_pre = pre;
+  d_post = post;
+}
+
+void spksim_t::set_clipping(float c_)
+{
+  c = c_;
+}
+
+void spksim_t::set_gain(float g_)
+{
+  g = g_;
+}
+
+/*
+  Linear stages of all lanes before and after the non-linearity, the
+  signal is interleaved. The states are passed as separate restrict
+  pointers, otherwise the alias analysis fails and the loop across
+  lanes is not vectorized.
+*/
+static void spksim_pre(float* __restrict__ x, uint32_t n, uint32_t nl,
+                       float* __restrict__ x1, float* __restrict__ y1,
+                       float* __restrict__ y2, float d_pre, float a, float b1,
+                       float b2)
+{
+  for(uint32_t i = 0; i < n; ++i) {
+    float* xi(x + i * nl);
+    for(uint32_t k = 0; k < nl; ++k) {
+      float v(std::min(SPKSIM_LIMIT, std::max(-SPKSIM_LIMIT, xi[k])));
+      // input differentiator:
+      float u(v - d_pre * x1[k]);
+      x1[k] = v;
+      // resonance filter:
+      float y(a * u + b1 * y1[k] + b2 * y2[k]);
+      y = std::min(SPKSIM_LIMIT, std::max(-SPKSIM_LIMIT, y));
+      y2[k] = y1[k];
+      y1[k] = y;
+      xi[k] = y;
+    }
+  }
+}
+
+static void spksim_post(float* __restrict__ x, uint32_t n, uint32_t nl,
+                        float* __restrict__ lp, float* __restrict__ z1,
+                        float lp1, float lp2, float d_post, float g)
+{
+  for(uint32_t i = 0; i < n; ++i) {
+    float* xi(x + i * nl);
+    for(uint32_t k = 0; k < nl; ++k) {
+      // low pass filter:
+      lp[k] = lp1 * lp[k] + lp2 * xi[k];
+      float y(lp[k]);
+      // output differentiator:
+      xi[k] = g * (y - d_post * z1[k]);
+      z1[k] = y;
+    }
+  }
+}
+
+/*
+  Soft clipper, the same for all lanes and samples.
+*/
+static void spksim_clip(float* __restrict__ x, uint32_t n, float c)
+{
+  for(uint32_t i = 0; i < n; ++i)
+    x[i] *= c / (c + fabsf(x[i]));
+}
+
+void spksim_t::process_chunk(uint32_t n)
+{
+  float* s(state.data());
+  spksim_pre(buf.data(), n, nl, s, s + nl, s + 2 * nl, d_pre, a, b1, b2);
+  if(halfbands.empty()) {
+    spksim_clip(buf.data(), n * nl, c);
+  } else {
+    const uint32_t nst(halfbands.size());
+    float* x(buf.data());
+    for(uint32_t k = 0; k < nst; ++k) {
+      halfbands[k].upsample(x, n << k, buf_os[k].data());
+      x = buf_os[k].data();
+    }
+    spksim_clip(x, (n << nst) * nl, c);
+    for(uint32_t k = nst; k > 0; --k)
+      halfbands[k - 1].downsample(buf_os[k - 1].data(), n << (k - 1),
+                                  (k > 1) ? buf_os[k - 2].data() : buf.data());
+  }
+  spksim_post(buf.data(), n, nl, s + 3 * nl, s + 4 * nl, lp1, lp2, d_post, g);
+}
+
+void spksim_t::process(uint32_t n, const std::vector<float*>& in,
+                       const std::vector<float*>& out)
+{
+  std::chrono::steady_clock::time_point t_start(
+      std::chrono::steady_clock::now());
+  const uint32_t N(std::min(nch, (uint32_t)std::min(in.size(), out.size())));
+  for(uint32_t t0 = 0; t0 < n; t0 += SPKSIM_CHUNK) {
+    uint32_t nc(std::min((uint32_t)SPKSIM_CHUNK, n - t0));
+    for(uint32_t k = 0; k < N; ++k) {
+      const float* x(&(in[k][t0]));
+      float* b(&(buf[k]));
+      for(uint32_t t = 0; t < nc; ++t)
+        b[t * nl] = x[t];
+    }
+    process_chunk(nc);
+    for(uint32_t k = 0; k < N; ++k) {
+      const float* b(&(buf[k]));
+      float* y(&(out[k][t0]));
+      for(uint32_t t = 0; t < nc; ++t)
+        y[t] = b[t * nl];
+    }
+  }
+  t_proc += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - t_start)
+                .count();
+  n_proc += n;
+}
+
+double spksim_t::cpu_load()
+{
+  double t(1.0e-9 * t_proc.exchange(0));
+  double n(n_proc.exchange(0));
+  if(n == 0)
+    return 0.0;
+  return t * fs_ / n;
+}
+
+/*
+ * Local Variables:
+ * mode: c++
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * compile-command: "make -C .."
+ * End:
+ */
@@ -0,0 +1,236 @@
+/**
+   \file libhos_spksim.h
+   \brief Non-linear loudspeaker simulation for many channels
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; version 2
+   of the License.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+   USA.
+
+*/
+#ifndef LIBHOS_SPKSIM_H
+#define LIBHOS_SPKSIM_H
+
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <stdint.h>
+#include <stdlib.h>
+#include <vector>
+
+namespace HoS {
+
+  /**
+     \brief Allocator which aligns to 32 bytes, the width of AVX
+     registers
+
+     With channel counts padded to a multiple of eight floats, each
+     state array and each interleaved sample of an aligned_vector_t
+     starts on a 32-byte boundary.
+   */
+  template <class T> class aligned_allocator_t {
+  public:
+    typedef T value_type;
+    aligned_allocator_t(){};
+    template <class U>
+    aligned_allocator_t(const aligned_allocator_t<U>&){};
+    T* allocate(size_t n)
+    {
+      void* p(NULL);
+      if(posix_memalign(&p, 32, std::max((size_t)1, n * sizeof(T))))
+        throw std::bad_alloc();
+      return (T*)p;
+    };
+    void deallocate(T* p, size_t) { free(p); };
+  };
+
+  template <class T, class U>
+  bool operator==(const aligned_allocator_t<T>&, const aligned_allocator_t<U>&)
+  {
+    return true;
+  }
+
+  template <class T, class U>
+  bool operator!=(const aligned_allocator_t<T>&, const aligned_allocator_t<U>&)
+  {
+    return false;
+  }
+
+  typedef std::vector<float, aligned_allocator_t<float>> aligned_vector_t;
+
+  /**
+     \brief Halfband filter for oversampling by two, for many channels
+
+     Polyphase implementation of a Kaiser windowed halfband FIR filter
+     with 4P-1 taps. Every second tap except the center tap is zero,
+     so each pair of high rate samples costs 2P multiply-adds per
+     channel. The signal is interleaved, with lanes values per sample,
+     and the inner loops run across the lanes. The group delay is 2P-1
+     samples at the low rate for upsampling and downsampling
+     together.
+   */
+  class halfband_t {
+  public:
+    /**
+       \param lanes Number of interleaved channels
+       \param maxlen Maximum number of samples at the low rate
+       \param P Half the number of non-zero taps besides the center tap
+       \param beta Kaiser window parameter
+    */
+    halfband_t(uint32_t lanes, uint32_t maxlen, uint32_t P, double beta);
+    /**
+       \brief Upsample by two
+       \param in Input, n samples
+       \param n Number of samples at the low rate
+       \param out Output, 2n samples
+    */
+    void upsample(const float* in, uint32_t n, float* out);
+    /**
+       \brief Downsample by two
+       \param in Input, 2n samples
+       \param n Number of samples at the low rate
+       \param out Output, n samples
+    */
+    void downsample(const float* in, uint32_t n, float* out);
+
+  private:
+    uint32_t nl;
+    uint32_t P;
+    // coefficients of the polyphase component with 2P taps:
+    std::vector<float> c;
+    // input history and new samples:
+    aligned_vector_t x_up;
+    aligned_vector_t x_down;
+  };
+
+  /**
+     \brief Non-linear loudspeaker model, applied to many channels
+
+     Each channel passes the stages
+
+     - differentiator (optional)
+     - two-pole resonance filter
+     - soft clipper, \f$y = x c / (c + |x|)\f$
+     - one-pole low pass filter
+     - differentiator (optional)
+     - gain
+
+     The soft clipper can run at an oversampled rate, by cascading one
+     or two halfband_t stages, to reduce aliasing of the harmonics. All
+     channels share the same coefficients. The states of all channels
+     are stored in separate arrays, and the inner loops run across
+     channels, so that several channels are processed in parallel in
+     the SIMD lanes. Blocks are processed in chunks of fixed size, with
+     the signal interleaved in a buffer; no memory is allocated during
+     processing.
+
+     The setters compute the coefficients and are meant to be called
+     from the audio thread, when the parameters have changed.
+   */
+  class spksim_t {
+  public:
+    /**
+       \param channels Number of channels
+       \param fs Sampling rate in Hz
+       \param oversampling Oversampling factor of the soft clipper, 1, 2
+       or 4
+    */
+    spksim_t(uint32_t channels, double fs, uint32_t oversampling = 1);
+    /**
+       \brief Set the resonance filter
+       \param f Resonance frequency in Hz
+       \param q Pole radius, 0 bypasses the filter
+    */
+    void set_resonance(double f, double q);
+    /**
+       \brief Set the low pass filter
+       \param fcut Cut-off frequency in Hz, values below or equal to
+       zero bypass the filter
+    */
+    void set_lowpass(double fcut);
+    /**
+       \brief Select the differentiators
+       \param pre Differentiate the input
+       \param post Differentiate the output
+    */
+    void set_differentiator(bool pre, bool post);
+    /**
+       \brief Set the clipping parameter c
+    */
+    void set_clipping(float c);
+    /**
+       \brief Set the linear output gain
+    */
+    void set_gain(float g);
+    /**
+       \brief Process one block
+       \param n Number of samples
+       \param in Input buffers, one for each channel
+       \param out Output buffers, one for each channel
+    */
+    void process(uint32_t n, const std::vector<float*>& in,
+                 const std::vector<float*>& out);
+    /**
+       \brief Processing time relative to real time since the last call
+
+       Thread safe, e.g., for reporting from the main thread.
+    */
+    double cpu_load();
+    /// Number of channels:
+    uint32_t size() const { return nch; };
+    /// Oversampling factor of the soft clipper:
+    uint32_t oversampling() const { return 1u << halfbands.size(); };
+    /// Additional delay by oversampling, in samples:
+    double latency() const { return latency_; };
+
+  private:
+    void process_chunk(uint32_t n);
+    double fs_;
+    uint32_t nch;
+    // number of channels padded to a multiple of the SIMD width:
+    uint32_t nl;
+    // coefficients:
+    float d_pre;
+    float a;
+    float b1;
+    float b2;
+    float c;
+    float lp1;
+    float lp2;
+    float d_post;
+    float g;
+    // states, one array of nl values for each state:
+    aligned_vector_t state;
+    // interleaved signal of one chunk:
+    aligned_vector_t buf;
+    // oversampling stages and interleaved signal at the higher rates:
+    std::vector<halfband_t> halfbands;
+    std::vector<aligned_vector_t> buf_os;
+    double latency_;
+    // processing time in nanoseconds and processed samples:
+    std::atomic<uint64_t> t_proc;
+    std::atomic<uint64_t> n_proc;
+  };
+
+} // namespace HoS
+
+#endif
+
+/*
+ * Local Variables:
+ * mode: c++
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * compile-command: "make -C .."
+ * End:
+ */
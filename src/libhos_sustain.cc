@@ -0,0 +1,144 @@
+#include "libhos_sustain.h"
+#include "hos_defs.h"
+#include <algorithm>
+#include <math.h>
+
+using namespace HoS;
+
+// gain below which a cleared layer is released:
+#define SUSTAIN_RELEASE_GAIN 1.0e-4f
+
+phase_table_t::phase_table_t(uint32_t nbins) : offset(0)
+{
+  // the table is much longer than a block to avoid audible
+  // repetitions:
+  uint32_t size(1 << 16);
+  while(size < 8 * nbins)
+    size *= 2;
+  mask = size - 1;
+  tab_re.resize(size + nbins);
+  tab_im.resize(size + nbins);
+  for(uint32_t k = 0; k < size; ++k) {
+    double phase(drand() * PI2);
+    tab_re[k] = cos(phase);
+    tab_im[k] = sin(phase);
+  }
+  // wrap around, so that any section can be read without index
+  // wrapping:
+  for(uint32_t k = 0; k < nbins; ++k) {
+    tab_re[size + k] = tab_re[k];
+    tab_im[size + k] = tab_im[k];
+  }
+}
+
+layer_t::layer_t(uint32_t nbins)
+    : absspec(nbins), gain(1.0f), tau(1.0f), currentgain(0.0f),
+      b_freeze(false), b_clear(false), b_valid(false), b_release(false)
+{
+}
+
+sustain_spec_t::sustain_spec_t(uint32_t nbins, uint32_t nlayers,
+                               double frame_rate_)
+    : tau_sustain(20), tau_envelope(1), livegain(1.0f), envgain(1.0f),
+      absspec(nbins), phases(nbins), frame_rate(frame_rate_), Lin(0),
+      Lout(0)
+{
+  for(uint32_t k = 0; k < nlayers; ++k)
+    layers.push_back(new layer_t(nbins));
+}
+
+sustain_spec_t::~sustain_spec_t()
+{
+  for(auto layer : layers)
+    delete layer;
+}
+
+/**
+   \brief Low pass coefficient of a time constant, at the frame rate
+ */
+static float lp_coeff(float tau, double frame_rate)
+{
+  if(tau > 0)
+    return exp(-1.0 / (tau * frame_rate));
+  return 0.0f;
+}
+
+void sustain_spec_t::process(TASCAR::spec_t& s)
+{
+  const float sus_c1(lp_coeff(tau_sustain, frame_rate));
+  const float sus_c2(1.0f - sus_c1);
+  float* spec((float*)(s.b));
+  float* abss(absspec.d);
+  const uint32_t N(std::min(s.n_, absspec.n));
+  double pin(0.0);
+  double pout(0.0);
+  for(uint32_t k = 0; k < N; k++) {
+    float p(spec[2 * k] * spec[2 * k] + spec[2 * k + 1] * spec[2 * k + 1]);
+    abss[k] = sus_c1 * abss[k] + sus_c2 * sqrtf(p);
+    pin += p;
+    pout += abss[k] * abss[k];
+  }
+  // envelope reconstruction of the live layer; with random phase, the
+  // power of the resynthesized layer is the sum of squared magnitudes:
+  const float env_c1(lp_coeff(tau_envelope, frame_rate));
+  Lin = env_c1 * Lin + (1.0 - env_c1) * pin;
+  Lout = env_c1 * Lout + (1.0 - env_c1) * pout;
+  if(Lout > 0)
+    envgain = sqrt(Lin / Lout);
+  s.clear();
+  add_layer(absspec, livegain * envgain, spec);
+  // frozen layers:
+  for(auto layer : layers) {
+    if(layer->b_clear.exchange(false))
+      layer->b_release = layer->b_valid;
+    if(layer->b_freeze.exchange(false)) {
+      layer->absspec.copy(absspec);
+      layer->b_valid = true;
+      layer->b_release = false;
+    }
+    if(!layer->b_valid)
+      continue;
+    const float c1(lp_coeff(layer->tau, frame_rate));
+    const float target(layer->b_release ? 0.0f : layer->gain);
+    layer->currentgain = c1 * layer->currentgain + (1.0f - c1) * target;
+    if(layer->b_release &&
+       (fabsf(layer->currentgain) < SUSTAIN_RELEASE_GAIN)) {
+      layer->currentgain = 0.0f;
+      layer->b_valid = false;
+      layer->b_release = false;
+      continue;
+    }
+    add_layer(layer->absspec, layer->currentgain, spec);
+  }
+}
+
+/**
+   \brief Add a magnitude spectrum with random phase to a spectrum
+   \param mag Magnitude spectrum
+   \param gain Linear gain
+   \param spec Complex spectrum, interleaved real and imaginary parts
+ */
+void sustain_spec_t::add_layer(const TASCAR::wave_t& mag, float gain,
+                               float* spec)
+{
+  if(gain == 0.0f)
+    return;
+  phases.next();
+  const float* p_re(phases.re());
+  const float* p_im(phases.im());
+  const float* m(mag.d);
+  const uint32_t N(mag.n);
+  for(uint32_t k = 0; k < N; k++) {
+    spec[2 * k] += gain * m[k] * p_re[k];
+    spec[2 * k + 1] += gain * m[k] * p_im[k];
+  }
+}
+
+/*
+ * Local Variables:
+ * mode: c++
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * compile-command: "make -C .."
+ * End:
+ */
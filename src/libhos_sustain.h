@@ -0,0 +1,140 @@
+/**
+   \file libhos_sustain.h
+   \brief Spectral sustain with frozen layers
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; version 2
+   of the License.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+   USA.
+
+*/
+#ifndef LIBHOS_SUSTAIN_H
+#define LIBHOS_SUSTAIN_H
+
+#include "libhos_random.h"
+#include <atomic>
+#include <stdint.h>
+#include <tascar/audiochunks.h>
+#include <vector>
+
+namespace HoS {
+
+  /**
+     \brief Table of unit phasors with random phase
+
+     Real and imaginary parts are stored in separate arrays. The random
+     phasors of one block are a contiguous section of the table,
+     starting at a random offset, so that no random number and no
+     complex exponential needs to be computed per bin.
+   */
+  class phase_table_t {
+  public:
+    phase_table_t(uint32_t nbins);
+    /// Select a new random section of the table:
+    void next() { offset = rng() & mask; };
+    /// Real parts of current section:
+    const float* re() const { return &(tab_re[offset]); };
+    /// Imaginary parts of current section:
+    const float* im() const { return &(tab_im[offset]); };
+
+  private:
+    std::vector<float> tab_re;
+    std::vector<float> tab_im;
+    uint32_t mask;
+    uint32_t offset;
+    xorshift_t rng;
+  };
+
+  /**
+     \brief Frozen magnitude spectrum
+
+     A layer is resynthesized with its own random phase and a gain
+     which follows the target gain with a first order low pass. A
+     cleared layer fades out with the same time constant, and its slot
+     is released when the gain has decayed.
+   */
+  class layer_t {
+  public:
+    layer_t(uint32_t nbins);
+    TASCAR::wave_t absspec;
+    float gain;
+    float tau;
+    float currentgain;
+    /// Freeze request, set by the control thread:
+    std::atomic<bool> b_freeze;
+    /// Clear request, set by the control thread:
+    std::atomic<bool> b_clear;
+    /// Layer is sounding or fading out:
+    bool b_valid;
+    /// Layer is fading out after a clear request:
+    bool b_release;
+  };
+
+  /**
+     \brief Spectral part of the sustain effect
+
+     The live layer is the magnitude spectrum of the input, smoothed
+     with the time constant tau_sustain. Its level is corrected to
+     follow the input envelope, smoothed with the time constant
+     tau_envelope, so that the live layer fades out when the input
+     stops. Frozen layers are copies of the live magnitude spectrum;
+     they are not envelope corrected, and their level depends only on
+     their own gain and time constant. All layers are resynthesized
+     with random phase and summed into one spectrum.
+   */
+  class sustain_spec_t {
+  public:
+    /**
+       \param nbins Number of frequency bins
+       \param nlayers Number of frozen layers
+       \param frame_rate Number of frames per second
+    */
+    sustain_spec_t(uint32_t nbins, uint32_t nlayers, double frame_rate);
+    ~sustain_spec_t();
+    /**
+       \brief Replace the spectrum of one frame by the sustained spectrum
+       \param s Spectrum of input frame, replaced by output spectrum
+    */
+    void process(TASCAR::spec_t& s);
+    /// Time constant of live sustain in seconds:
+    float tau_sustain;
+    /// Time constant of envelope reconstruction in seconds:
+    float tau_envelope;
+    /// Gain of the live layer:
+    float livegain;
+    /// Envelope correction gain of the live layer in the last frame:
+    float envgain;
+    std::vector<layer_t*> layers;
+
+  private:
+    void add_layer(const TASCAR::wave_t& mag, float gain, float* spec);
+    TASCAR::wave_t absspec;
+    phase_table_t phases;
+    double frame_rate;
+    // smoothed power of input and uncorrected live layer:
+    double Lin;
+    double Lout;
+  };
+
+} // namespace HoS
+
+#endif
+
+/*
+ * Local Variables:
+ * mode: c++
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * compile-command: "make -C .."
+ * End:
+ */
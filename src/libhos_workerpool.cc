@@ -0,0 +1,87 @@
+#include "libhos_workerpool.h"
+#include <pthread.h>
+
+using namespace HoS;
+
+worker_pool_t::worker_pool_t(uint32_t nthreads, int priority)
+    : generation(0), pending(0), b_quit(false), cur_job(NULL),
+      cur_data(NULL), cur_njobs(0), next_job(0)
+{
+  for(uint32_t k = 1; k < nthreads; ++k) {
+    threads.push_back(std::thread(&worker_pool_t::thread_fun, this));
+    if(priority > 0) {
+      // failure is not fatal, the thread then runs with normal
+      // scheduling:
+      struct sched_param param;
+      param.sched_priority = priority;
+      pthread_setschedparam(threads.back().native_handle(), SCHED_FIFO,
+                            &param);
+    }
+  }
+}
+
+worker_pool_t::~worker_pool_t()
+{
+  {
+    std::lock_guard<std::mutex> lk(mtx);
+    b_quit = true;
+  }
+  cond_start.notify_all();
+  for(auto& th : threads)
+    th.join();
+}
+
+void worker_pool_t::run(uint32_t njobs, job_t job, void* data)
+{
+  if(threads.empty() || (njobs < 2)) {
+    for(uint32_t k = 0; k < njobs; ++k)
+      job(k, data);
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lk(mtx);
+    cur_job = job;
+    cur_data = data;
+    cur_njobs = njobs;
+    next_job = 0;
+    pending = threads.size();
+    ++generation;
+  }
+  cond_start.notify_all();
+  work();
+  std::unique_lock<std::mutex> lk(mtx);
+  cond_done.wait(lk, [this] { return pending == 0; });
+}
+
+void worker_pool_t::work()
+{
+  uint32_t k;
+  while((k = next_job.fetch_add(1)) < cur_njobs)
+    cur_job(k, cur_data);
+}
+
+void worker_pool_t::thread_fun()
+{
+  uint64_t gen(0);
+  std::unique_lock<std::mutex> lk(mtx);
+  while(true) {
+    cond_start.wait(lk, [&] { return b_quit || (generation != gen); });
+    if(b_quit)
+      return;
+    gen = generation;
+    lk.unlock();
+    work();
+    lk.lock();
+    if(--pending == 0)
+      cond_done.notify_one();
+  }
+}
+
+/*
+ * Local Variables:
+ * mode: c++
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * compile-command: "make -C .."
+ * End:
+ */
@@ -0,0 +1,93 @@
+/**
+   \file libhos_workerpool.h
+   \brief Pool of worker threads for parallel block processing
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; version 2
+   of the License.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+   USA.
+
+*/
+#ifndef LIBHOS_WORKERPOOL_H
+#define LIBHOS_WORKERPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+namespace HoS {
+
+  /**
+     \brief Pool of worker threads
+
+     A set of independent jobs, e.g., the channels of a multi-channel
+     signal processing block, is distributed on the worker threads
+     and the calling thread. The threads are created once in the
+     constructor; run() does not allocate memory.
+   */
+  class worker_pool_t {
+  public:
+    /**
+       \brief Job function
+       \param k Job index
+       \param data User data
+    */
+    typedef void (*job_t)(uint32_t k, void* data);
+    /**
+       \param nthreads Number of threads including the calling thread
+       \param priority Real-time priority of worker threads, or 0 for
+       normal scheduling
+    */
+    worker_pool_t(uint32_t nthreads, int priority = 0);
+    ~worker_pool_t();
+    /**
+       \brief Process jobs in parallel and wait for completion
+       \param njobs Number of jobs
+       \param job Job function, called once for each job index
+       \param data User data passed to job function
+    */
+    void run(uint32_t njobs, job_t job, void* data);
+    /// Number of threads including the calling thread:
+    uint32_t size() const { return threads.size() + 1; };
+
+  private:
+    void thread_fun();
+    void work();
+    std::vector<std::thread> threads;
+    std::mutex mtx;
+    std::condition_variable cond_start;
+    std::condition_variable cond_done;
+    uint64_t generation;
+    uint32_t pending;
+    bool b_quit;
+    job_t cur_job;
+    void* cur_data;
+    uint32_t cur_njobs;
+    std::atomic<uint32_t> next_job;
+  };
+
+} // namespace HoS
+
+#endif
+
+/*
+ * Local Variables:
+ * mode: c++
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * compile-command: "make -C .."
+ * End:
+ */
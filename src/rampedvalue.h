@@ -0,0 +1,187 @@
+/**
+   \file rampedvalue.h
+   \brief Lock-free parameter with linear ramps
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+  USA.
+
+*/
+#ifndef RAMPEDVALUE_H
+#define RAMPEDVALUE_H
+
+#include <algorithm>
+#include <atomic>
+#include <lo/lo.h>
+#include <stdint.h>
+
+namespace HoS {
+
+  /**
+     \brief Parameter which is set by a control thread and ramped
+     linearly in the audio thread
+
+     The control thread (e.g., the OSC server) publishes a target
+     value and a ramp duration, protected by a sequence counter. The
+     audio thread calls update() at the beginning of each block, which
+     takes over the most recent target without blocking. A new target
+     is thus applied at the next block boundary; only if the control
+     thread is writing at the same moment, it is applied one block
+     later.
+
+     There must be only one control thread calling set().
+   */
+  template <class T> class ramped_value_t {
+  public:
+    /**
+       \param v Initial value
+       \param fs Sampling rate, used to convert ramp durations to
+       samples
+    */
+    ramped_value_t(T v = 0, double fs = 1.0)
+        : seq(0), p_val(v), p_time(0), fs_(fs), seq_applied(0), val(v),
+          target(v), inc(0), remaining(0){};
+    /**
+       \brief Set new target value (control thread)
+       \param v Target value
+       \param duration Ramp duration in seconds
+    */
+    void set(T v, double duration)
+    {
+      uint32_t s(seq.load(std::memory_order_relaxed));
+      seq.store(s + 1, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+      p_val.store(v, std::memory_order_relaxed);
+      p_time.store((uint32_t)(std::max(0.0, duration * fs_)),
+                   std::memory_order_relaxed);
+      seq.store(s + 2, std::memory_order_release);
+    };
+    /**
+       \brief Take over the most recent target (audio thread, once per
+       block)
+    */
+    void update()
+    {
+      uint32_t s1(seq.load(std::memory_order_acquire));
+      if((s1 == seq_applied) || (s1 & 1))
+        return;
+      T v(p_val.load(std::memory_order_relaxed));
+      uint32_t t(p_time.load(std::memory_order_relaxed));
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if(seq.load(std::memory_order_relaxed) != s1)
+        return;
+      seq_applied = s1;
+      target = v;
+      remaining = t;
+      if(remaining)
+        inc = (target - val) / (T)remaining;
+      else
+        val = target;
+    };
+    /**
+       \brief Advance by one sample (audio thread)
+       \return Current value
+    */
+    inline T step()
+    {
+      if(remaining) {
+        --remaining;
+        if(remaining)
+          val += inc;
+        else
+          val = target;
+      }
+      return val;
+    };
+    /**
+       \brief Fill a block with the ramped value and advance (audio
+       thread)
+       \param v Output, n values
+       \param n Number of samples
+    */
+    void process(T* v, uint32_t n)
+    {
+      uint32_t m(std::min(n, remaining));
+      const T v0(val);
+      for(uint32_t i = 0; i < m; ++i)
+        v[i] = v0 + (T)(i + 1) * inc;
+      remaining -= m;
+      if(remaining)
+        val = v0 + (T)m * inc;
+      else
+        val = target;
+      const T vc(val);
+      for(uint32_t i = m; i < n; ++i)
+        v[i] = vc;
+    };
+    /**
+       \brief Set the current value and stop ramping (audio thread)
+    */
+    void set_current(T v)
+    {
+      val = v;
+      target = v;
+      remaining = 0;
+    };
+    /// Current value (audio thread):
+    T current() const { return val; };
+    /// True if the value changes within the next samples (audio thread):
+    bool ramping() const { return remaining > 0; };
+
+  private:
+    // published by control thread:
+    std::atomic<uint32_t> seq;
+    std::atomic<T> p_val;
+    std::atomic<uint32_t> p_time;
+    double fs_;
+    // audio thread:
+    uint32_t seq_applied;
+    T val;
+    T target;
+    T inc;
+    uint32_t remaining;
+  };
+
+  /**
+     \brief OSC handler for ramped_value_t
+
+     Arguments are either target value and ramp duration in seconds
+     ("ff"), or only the target value ("f" or "d"), which is then
+     applied without ramp. user_data points to the ramped_value_t.
+  */
+  template <class T>
+  int osc_set_ramp(const char* path, const char* types, lo_arg** argv,
+                   int argc, lo_message msg, void* user_data)
+  {
+    ramped_value_t<T>* p((ramped_value_t<T>*)user_data);
+    if(p && (argc == 2) && (types[0] == 'f') && (types[1] == 'f'))
+      p->set(argv[0]->f, argv[1]->f);
+    if(p && (argc == 1) && (types[0] == 'f'))
+      p->set(argv[0]->f, 0.0);
+    if(p && (argc == 1) && (types[0] == 'd'))
+      p->set(argv[0]->d, 0.0);
+    return 0;
+  }
+
+} // namespace HoS
+
+#endif
+
+/*
+ * Local Variables:
+ * mode: c++
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * compile-command: "make -C .."
+ * End:
+ */
@@ -0,0 +1,99 @@
+/**
+   \file spscqueue.h
+   \brief Lock-free single producer single consumer queue
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+  USA.
+
+*/
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <atomic>
+#include <stdint.h>
+#include <vector>
+
+namespace HoS {
+
+  /**
+     \brief Lock-free queue of fixed capacity for one producer and one
+     consumer thread
+
+     Neither push() nor pop() block or allocate memory, thus both can
+     be used in real-time threads.
+   */
+  template <class T> class spsc_queue_t {
+  public:
+    /**
+       \param capacity Maximum number of elements in the queue
+    */
+    spsc_queue_t(uint32_t capacity) : buf(capacity + 1), r(0), w(0){};
+    /**
+       \brief Add an element (producer thread only)
+       \return False if the queue is full and the element was dropped
+    */
+    bool push(const T& v)
+    {
+      uint32_t wp(w.load(std::memory_order_relaxed));
+      uint32_t next(wrap(wp + 1));
+      if(next == r.load(std::memory_order_acquire))
+        return false;
+      buf[wp] = v;
+      w.store(next, std::memory_order_release);
+      return true;
+    };
+    /**
+       \brief Remove the oldest element (consumer thread only)
+       \return False if the queue is empty
+    */
+    bool pop(T& v)
+    {
+      uint32_t rp(r.load(std::memory_order_relaxed));
+      if(rp == w.load(std::memory_order_acquire))
+        return false;
+      v = buf[rp];
+      r.store(wrap(rp + 1), std::memory_order_release);
+      return true;
+    };
+    /**
+       \brief Check if queue is empty (consumer thread only)
+    */
+    bool empty() const
+    {
+      return r.load(std::memory_order_relaxed) ==
+             w.load(std::memory_order_acquire);
+    };
+
+  private:
+    inline uint32_t wrap(uint32_t k) const
+    {
+      return (k < buf.size()) ? k : 0;
+    };
+    std::vector<T> buf;
+    std::atomic<uint32_t> r;
+    std::atomic<uint32_t> w;
+  };
+
+} // namespace HoS
+
+#endif
+
+/*
+ * Local Variables:
+ * mode: c++
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * compile-command: "make -C .."
+ * End:
+ */
@@ -0,0 +1,297 @@
+#include "ambpan.h"
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string.h>
+#include <string>
+#include <vector>
+
+typedef std::chrono::high_resolution_clock tclock_t;
+
+double ms_since(tclock_t::time_point t0)
+{
+  return std::chrono::duration<double, std::milli>(tclock_t::now() - t0)
+      .count();
+}
+
+/*
+  Checks of the ambisonics panners: the 3rd order horizontal
+  coefficients match the polynomials of the former amb_coeff class,
+  the block method matches the per-sample methods across coefficient
+  ramps, and the full sphere coefficients match the closed form ACN /
+  SN3D spherical harmonics up to second order.
+
+  Benchmark of the ambisonics panners: one source with three panners
+  (dry, left and right reverb) into a 3rd order horizontal bus,
+  per-sample addpan30() as used in hos_sphere_amb30 before versus
+  the block method, and block processing of higher orders.
+ */
+
+static uint32_t nfail(0);
+
+void check(bool ok, const std::string& msg)
+{
+  if(!ok) {
+    std::cout << "FAIL: " << msg << std::endl;
+    ++nfail;
+  }
+}
+
+/*
+  Coefficients of the former amb_coeff::set(), in the channel order
+  W, X, Y, U, V, P, Q.
+*/
+void coeff_amb30(float az, float el, float gain, float* c)
+{
+  float t(cosf(el));
+  gain *= 2.0f - fabsf(t);
+  float x(t * cosf(az));
+  float y(t * sinf(az));
+  float x2(x * x);
+  float y2(y * y);
+  c[0] = gain * MIN3DB;
+  c[1] = gain * x;
+  c[2] = gain * y;
+  c[3] = gain * (x2 - y2);
+  c[4] = gain * 2.0f * x * y;
+  c[5] = gain * (x2 - 3.0f * y2) * x;
+  c[6] = gain * (3.0f * x2 - y2) * y;
+}
+
+void test_coeff_2d()
+{
+  double err(0.0);
+  for(int32_t kaz = -12; kaz <= 12; ++kaz)
+    for(int32_t kel = -6; kel <= 6; ++kel) {
+      const float az(kaz * M_PI / 12.0);
+      const float el(kel * M_PI / 12.0);
+      const float gain(0.5f + 0.1f * kel);
+      float c[7];
+      float c_ref[7];
+      HoS::ambpan_t<3>::coeff(az, el, gain, c);
+      coeff_amb30(az, el, gain, c_ref);
+      for(uint32_t k = 0; k < 7; ++k)
+        err = std::max(err, (double)fabsf(c[k] - c_ref[k]));
+    }
+  std::cout << "2D 3rd order coefficients: max error " << err << std::endl;
+  check(err < 1e-5, "ambpan_t<3> coefficients differ from amb_coeff");
+}
+
+void test_coeff_3d()
+{
+  const float s3(sqrtf(3.0f) / 2.0f);
+  double err(0.0);
+  for(int32_t kaz = -12; kaz <= 12; ++kaz)
+    for(int32_t kel = -6; kel <= 6; ++kel) {
+      const float az(kaz * M_PI / 12.0);
+      const float el(kel * M_PI / 12.0);
+      const float ce(cosf(el));
+      const float se(sinf(el));
+      // ACN 0 to 8, SN3D:
+      const float c_ref[9] = {1.0f,
+                              ce * sinf(az),
+                              se,
+                              ce * cosf(az),
+                              s3 * ce * ce * sinf(2.0f * az),
+                              s3 * sinf(2.0f * el) * sinf(az),
+                              0.5f * (3.0f * se * se - 1.0f),
+                              s3 * sinf(2.0f * el) * cosf(az),
+                              s3 * ce * ce * cosf(2.0f * az)};
+      float c[9];
+      HoS::amb_coeff_3d(2, az, el, c);
+      for(uint32_t k = 0; k < 9; ++k)
+        err = std::max(err, (double)fabsf(c[k] - c_ref[k]));
+    }
+  std::cout << "3D coefficients up to 2nd order: max error " << err
+            << std::endl;
+  check(err < 1e-5, "amb_coeff_3d differs from closed form ACN/SN3D");
+}
+
+/*
+  Block add() versus per-sample add(), and for the 3rd order
+  horizontal panner also versus per-sample addpan30(), with noise
+  input and a new target every dt samples. The block size is not a
+  multiple of the chunk size, and not a divisor of dt.
+*/
+template <uint32_t order, bool b3d> void test_block_vs_sample()
+{
+  typedef HoS::ambpan_t<order, b3d> pan_t;
+  const uint32_t C(pan_t::channels);
+  const uint32_t dt(250);
+  const uint32_t n(100);
+  static_assert(n % AMBPAN_CHUNK != 0, "block size is multiple of chunk");
+  pan_t p_block(dt);
+  pan_t p_sample(dt);
+  HoS::amb_coeff p_amb30(dt);
+  std::vector<float> buf(C * n);
+  std::vector<float*> out(C);
+  for(uint32_t k = 0; k < C; ++k)
+    out[k] = &(buf[k * n]);
+  std::vector<float> frame(C);
+  float f30[7];
+  std::mt19937 gen(1);
+  std::uniform_real_distribution<float> d_sym(-1.0f, 1.0f);
+  std::vector<float> in(n);
+  double err(0.0);
+  double err30(0.0);
+  double ymax(0.0);
+  uint32_t t(0);
+  for(uint32_t b = 0; b < 40; ++b) {
+    for(auto& v : in)
+      v = d_sym(gen);
+    memset(buf.data(), 0, buf.size() * sizeof(float));
+    for(uint32_t i = 0; i < n; ++i, ++t) {
+      if(t % dt == 0) {
+        float az(0.7f * t / dt);
+        float el(0.3f * sinf(0.1f * t / dt));
+        float gain(0.5f + 0.25f * cosf(0.3f * t / dt));
+        p_sample.set(az, el, gain);
+        p_amb30.set(az, el, gain);
+      }
+      pan_t::clear(frame.data());
+      p_sample.add(in[i], frame.data());
+      for(uint32_t k = 0; k < C; ++k)
+        buf[k * n + i] = frame[k];
+      if(!b3d && (order == 3)) {
+        p_amb30.clear(f30[0], f30[1], f30[2], f30[3], f30[4], f30[5],
+                      f30[6]);
+        p_amb30.addpan30(in[i], f30[0], f30[1], f30[2], f30[3], f30[4],
+                         f30[5], f30[6]);
+        for(uint32_t k = 0; k < 7; ++k)
+          err30 = std::max(err30, (double)fabsf(f30[k] - frame[k]));
+      }
+    }
+    // block processing of the same input, with the same targets:
+    std::vector<float> bbuf(C * n, 0.0f);
+    std::vector<float*> bout(C);
+    for(uint32_t k = 0; k < C; ++k)
+      bout[k] = &(bbuf[k * n]);
+    const uint32_t t0(b * n);
+    for(uint32_t i0 = 0; i0 < n;) {
+      // split the block at target updates, a block panner is set
+      // before processing:
+      uint32_t tb(t0 + i0);
+      if(tb % dt == 0) {
+        float az(0.7f * tb / dt);
+        float el(0.3f * sinf(0.1f * tb / dt));
+        float gain(0.5f + 0.25f * cosf(0.3f * tb / dt));
+        p_block.set(az, el, gain);
+      }
+      uint32_t nb(std::min(n - i0, dt - tb % dt));
+      std::vector<float*> bo(C);
+      for(uint32_t k = 0; k < C; ++k)
+        bo[k] = bout[k] + i0;
+      p_block.add(&(in[i0]), nb, bo.data());
+      i0 += nb;
+    }
+    for(uint32_t k = 0; k < C * n; ++k) {
+      err = std::max(err, (double)fabsf(bbuf[k] - buf[k]));
+      ymax = std::max(ymax, (double)fabsf(buf[k]));
+    }
+  }
+  std::cout << (b3d ? "3D" : "2D") << " order " << order
+            << " block versus per sample: max error " << err
+            << " (max output " << ymax << ")" << std::endl;
+  check(err < 1e-4 * ymax, "block add() differs from per-sample add()");
+  if(!b3d && (order == 3)) {
+    std::cout << "2D order 3 add() versus addpan30(): max error " << err30
+              << std::endl;
+    check(err30 < 1e-4 * ymax, "add() differs from addpan30()");
+  }
+}
+
+template <uint32_t order, bool b3d>
+double bench_block(uint32_t n, uint32_t nblocks, const std::vector<float>& in)
+{
+  typedef HoS::ambpan_t<order, b3d> pan_t;
+  std::vector<float> buf(pan_t::channels * n);
+  std::vector<float*> out(pan_t::channels);
+  for(uint32_t k = 0; k < pan_t::channels; ++k)
+    out[k] = &(buf[k * n]);
+  pan_t p1(1920), p2(1920), p3(1920);
+  tclock_t::time_point t0(tclock_t::now());
+  for(uint32_t b = 0; b < nblocks; ++b) {
+    if((b * n) % 1920 < n) {
+      p1.set(0.001f * b, 0.1f, 0.5f);
+      p2.set(0.001f * b + 0.3f, 0.2f, 0.25f);
+      p3.set(0.001f * b - 0.3f, 0.2f, 0.25f);
+    }
+    memset(buf.data(), 0, buf.size() * sizeof(float));
+    p1.add(&(in[0]), n, out.data());
+    p2.add(&(in[n]), n, out.data());
+    p3.add(&(in[2 * n]), n, out.data());
+  }
+  return ms_since(t0);
+}
+
+int main(int argc, char** argv)
+{
+  test_coeff_2d();
+  test_coeff_3d();
+  test_block_vs_sample<3, false>();
+  test_block_vs_sample<7, false>();
+  test_block_vs_sample<2, true>();
+  test_block_vs_sample<5, true>();
+  const uint32_t NTOTAL(1 << 22);
+  std::mt19937 gen(1);
+  std::uniform_real_distribution<float> d_sym(-1.0f, 1.0f);
+  std::vector<float> in(3 * 1024);
+  for(auto& v : in)
+    v = d_sym(gen);
+  for(uint32_t n : {64u, 256u, 1024u}) {
+    const uint32_t nblocks(NTOTAL / n);
+    // per-sample path:
+    std::vector<float> buf(7 * n);
+    float* W(&(buf[0]));
+    float* X(&(buf[n]));
+    float* Y(&(buf[2 * n]));
+    float* U(&(buf[3 * n]));
+    float* V(&(buf[4 * n]));
+    float* P(&(buf[5 * n]));
+    float* Q(&(buf[6 * n]));
+    HoS::amb_coeff a1(1920), a2(1920), a3(1920);
+    tclock_t::time_point t0(tclock_t::now());
+    for(uint32_t b = 0; b < nblocks; ++b) {
+      if((b * n) % 1920 < n) {
+        a1.set(0.001f * b, 0.1f, 0.5f);
+        a2.set(0.001f * b + 0.3f, 0.2f, 0.25f);
+        a3.set(0.001f * b - 0.3f, 0.2f, 0.25f);
+      }
+      for(uint32_t i = 0; i < n; ++i) {
+        a1.clear(W[i], X[i], Y[i], U[i], V[i], P[i], Q[i]);
+        a1.addpan30(in[i], W[i], X[i], Y[i], U[i], V[i], P[i], Q[i]);
+        a2.addpan30(in[n + i], W[i], X[i], Y[i], U[i], V[i], P[i], Q[i]);
+        a3.addpan30(in[2 * n + i], W[i], X[i], Y[i], U[i], V[i], P[i], Q[i]);
+      }
+    }
+    double t_sample(ms_since(t0));
+    double t_block(bench_block<3, false>(n, nblocks, in));
+    double t_2d7(bench_block<7, false>(n, nblocks, in));
+    double t_3d3(bench_block<3, true>(n, nblocks, in));
+    double t_3d7(bench_block<7, true>(n, nblocks, in));
+    // time per second of audio at 48 kHz:
+    const double sc(48000.0 / (nblocks * n));
+    std::cout << n << " frames, ms per second of audio at 48 kHz:\n"
+              << "  2D 3rd order per sample " << t_sample * sc << "\n"
+              << "  2D 3rd order block      " << t_block * sc << " (speedup "
+              << t_sample / t_block << ")\n"
+              << "  2D 7th order block      " << t_2d7 * sc << "\n"
+              << "  3D 3rd order block      " << t_3d3 * sc << "\n"
+              << "  3D 7th order block      " << t_3d7 * sc << std::endl;
+  }
+  if(nfail) {
+    std::cout << nfail << " checks failed." << std::endl;
+    return 1;
+  }
+  std::cout << "All checks passed." << std::endl;
+  return 0;
+}
+
+/*
+ * Local Variables:
+ * mode: c++
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * compile-command: "make -C .."
+ * End:
+ */
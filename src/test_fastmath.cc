@@ -0,0 +1,131 @@
+#include "fastmath.h"
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <vector>
+
+typedef std::chrono::high_resolution_clock tclock_t;
+
+double ms_since(tclock_t::time_point t0)
+{
+  return std::chrono::duration<double, std::milli>(tclock_t::now() - t0)
+      .count();
+}
+
+void report(const std::string& name, double err, double t_fast, double t_libm)
+{
+  std::cout << name << ": max error " << err << ", fast " << t_fast
+            << " ms, libm " << t_libm << " ms, speedup " << t_libm / t_fast
+            << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+  const uint32_t N(1 << 16);
+  const uint32_t REP(200);
+  std::mt19937 gen(1);
+  std::uniform_real_distribution<float> d_sym(-1.0f, 1.0f);
+  std::vector<float> x(N), y(N), out(N), ref(N);
+  std::vector<std::complex<float>> c(N), cref(N);
+  double err;
+  tclock_t::time_point t0;
+  double t_fast, t_libm;
+  // atan2:
+  for(uint32_t k = 0; k < N; ++k) {
+    x[k] = d_sym(gen);
+    y[k] = d_sym(gen);
+  }
+  t0 = tclock_t::now();
+  for(uint32_t r = 0; r < REP; ++r)
+    HoS::fastmath::atan2(y.data(), x.data(), out.data(), N);
+  t_fast = ms_since(t0);
+  t0 = tclock_t::now();
+  for(uint32_t r = 0; r < REP; ++r)
+    for(uint32_t k = 0; k < N; ++k)
+      ref[k] = atan2f(y[k], x[k]);
+  t_libm = ms_since(t0);
+  err = 0.0;
+  for(uint32_t k = 0; k < N; ++k)
+    err = std::max(err, fabs((double)out[k] - atan2((double)y[k], x[k])));
+  report("atan2 (abs)", err, t_fast, t_libm);
+  // exp:
+  for(uint32_t k = 0; k < N; ++k)
+    x[k] = 87.0f * d_sym(gen);
+  t0 = tclock_t::now();
+  for(uint32_t r = 0; r < REP; ++r)
+    HoS::fastmath::exp(x.data(), out.data(), N);
+  t_fast = ms_since(t0);
+  t0 = tclock_t::now();
+  for(uint32_t r = 0; r < REP; ++r)
+    for(uint32_t k = 0; k < N; ++k)
+      ref[k] = expf(x[k]);
+  t_libm = ms_since(t0);
+  err = 0.0;
+  for(uint32_t k = 0; k < N; ++k)
+    err = std::max(err, fabs((double)out[k] / exp((double)x[k]) - 1.0));
+  report("exp (rel)", err, t_fast, t_libm);
+  // log2:
+  for(uint32_t k = 0; k < N; ++k)
+    x[k] = powf(2.0f, 60.0f * d_sym(gen));
+  t0 = tclock_t::now();
+  for(uint32_t r = 0; r < REP; ++r)
+    HoS::fastmath::log2(x.data(), out.data(), N);
+  t_fast = ms_since(t0);
+  t0 = tclock_t::now();
+  for(uint32_t r = 0; r < REP; ++r)
+    for(uint32_t k = 0; k < N; ++k)
+      ref[k] = log2f(x[k]);
+  t_libm = ms_since(t0);
+  err = 0.0;
+  for(uint32_t k = 0; k < N; ++k)
+    err = std::max(err, fabs((double)out[k] - log2((double)x[k])));
+  report("log2 (abs)", err, t_fast, t_libm);
+  // unit phasor:
+  for(uint32_t k = 0; k < N; ++k)
+    x[k] = 1000.0f * d_sym(gen);
+  t0 = tclock_t::now();
+  for(uint32_t r = 0; r < REP; ++r)
+    HoS::fastmath::cis(x.data(), c.data(), N);
+  t_fast = ms_since(t0);
+  t0 = tclock_t::now();
+  for(uint32_t r = 0; r < REP; ++r)
+    for(uint32_t k = 0; k < N; ++k)
+      cref[k] = std::exp(std::complex<float>(0.0f, x[k]));
+  t_libm = ms_since(t0);
+  err = 0.0;
+  for(uint32_t k = 0; k < N; ++k) {
+    err = std::max(err, fabs((double)c[k].real() - cos((double)x[k])));
+    err = std::max(err, fabs((double)c[k].imag() - sin((double)x[k])));
+  }
+  report("cis (abs)", err, t_fast, t_libm);
+  // complex magnitude:
+  for(uint32_t k = 0; k < N; ++k)
+    c[k] = std::complex<float>(d_sym(gen), d_sym(gen));
+  t0 = tclock_t::now();
+  for(uint32_t r = 0; r < REP; ++r)
+    HoS::fastmath::abs(c.data(), out.data(), N);
+  t_fast = ms_since(t0);
+  t0 = tclock_t::now();
+  for(uint32_t r = 0; r < REP; ++r)
+    for(uint32_t k = 0; k < N; ++k)
+      ref[k] = std::abs(c[k]);
+  t_libm = ms_since(t0);
+  err = 0.0;
+  for(uint32_t k = 0; k < N; ++k)
+    err = std::max(err, fabs((double)out[k] - (double)ref[k]));
+  report("abs (abs)", err, t_fast, t_libm);
+  // keep results alive:
+  float sum(0.0f);
+  for(uint32_t k = 0; k < N; ++k)
+    sum += ref[k] + cref[k].real();
+  return (sum == 12345.0f);
+}
+
+/*
+ * Local Variables:
+ * mode: c++
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * compile-command: "make -C .."
+ * End:
+ */
@@ -0,0 +1,251 @@
+#include "gammatone.h"
+#include "libhos_filterbank.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <math.h>
+#include <random>
+#include <vector>
+
+typedef std::chrono::high_resolution_clock tclock_t;
+
+double ms_since(tclock_t::time_point t0)
+{
+  return std::chrono::duration<double, std::milli>(tclock_t::now() - t0)
+      .count();
+}
+
+/*
+  Checks of the filterbanks: each gammatone band has its maximum
+  response to a cosine at its center frequency, with unit gain, and
+  the constant-Q kernel of each band is normalized, peaks at the bin
+  of the center frequency and is triangular on a logarithmic
+  frequency axis. The block API of the gammatone bank is compared with
+  the single band gammatone_t, and its run time is measured.
+ */
+
+static uint32_t nfail(0);
+
+void check(bool ok, const std::string& msg)
+{
+  if(!ok) {
+    std::cout << "FAIL: " << msg << std::endl;
+    ++nfail;
+  }
+}
+
+/*
+  Mean power of each band in response to a cosine of frequency f,
+  after the transient has decayed.
+*/
+std::vector<float> cos_response(HoS::gammatone_bank_t& gt, double f,
+                                double fs)
+{
+  TASCAR::wave_t w(fs / 4);
+  for(uint32_t t = 0; t < w.n; ++t)
+    w.d[t] = cos(2.0 * M_PI * f * t / fs);
+  gt.process(w);
+  for(uint32_t t = 0; t < w.n; ++t)
+    w.d[t] = cos(2.0 * M_PI * f * (t + w.n) / fs);
+  gt.process(w);
+  return std::vector<float>(gt.power.d, gt.power.d + gt.size());
+}
+
+void test_passband(double fs)
+{
+  std::vector<float> f(HoS::logfreqs(100.0f, 8000.0f, 2.0f));
+  std::vector<float> bw;
+  for(auto v : f)
+    bw.push_back(HoS::erb(v));
+  // probe frequencies in steps of 1/48 octave around each center:
+  const int32_t nprobe(6);
+  std::vector<std::vector<float>> resp(f.size());
+  for(uint32_t k = 0; k < f.size(); ++k)
+    for(int32_t j = -nprobe; j <= nprobe; ++j) {
+      HoS::gammatone_bank_t gt(f, bw, fs);
+      resp[k].push_back(cos_response(gt, f[k] * pow(2.0, j / 48.0), fs)[k]);
+    }
+  for(uint32_t k = 0; k < f.size(); ++k) {
+    uint32_t jmax(0);
+    for(uint32_t j = 0; j < resp[k].size(); ++j)
+      if(resp[k][j] > resp[k][jmax])
+        jmax = j;
+    float g_db(10.0f * log10f(resp[k][nprobe]));
+    std::cout << "gammatone " << f[k] << " Hz: gain at center " << g_db
+              << " dB, peak at " << (int32_t)jmax - nprobe << "/48 octave"
+              << std::endl;
+    check(jmax == nprobe, "gammatone peak not at center frequency");
+    check(fabsf(g_db) < 0.5f, "gammatone gain at center frequency");
+  }
+}
+
+void test_constq_kernel(double fs)
+{
+  const uint32_t fftlen(4096);
+  const float bpo(12.0f);
+  const double df(fs / fftlen);
+  HoS::constq_t cq(fftlen, fs, 27.5f, 8000.0f, bpo);
+  const uint32_t nbins(fftlen / 2 + 1);
+  // kernel weights, from the response to each bin:
+  std::vector<std::vector<float>> w(cq.size(), std::vector<float>(nbins));
+  TASCAR::spec_t X(nbins);
+  for(uint32_t b = 0; b < nbins; ++b) {
+    for(uint32_t k = 0; k < nbins; ++k)
+      X.b[k] = 0.0f;
+    X.b[b] = 1.0f;
+    cq.process(X);
+    for(uint32_t k = 0; k < cq.size(); ++k)
+      w[k][b] = cq.power.d[k];
+  }
+  uint32_t ninterp(0);
+  for(uint32_t k = 0; k < cq.size(); ++k) {
+    const float f(cq.fc[k]);
+    double wsum(0.0);
+    uint32_t bmax(0);
+    for(uint32_t b = 0; b < nbins; ++b) {
+      wsum += w[k][b];
+      if(w[k][b] > w[k][bmax])
+        bmax = b;
+    }
+    check(fabs(wsum - 1.0) < 1e-5, "constant-Q kernel not normalized");
+    check(fabs(bmax * df - f) <= df,
+          "constant-Q kernel does not peak at center frequency");
+    // expected triangular shape, or interpolation of two bins if no
+    // bin is within the triangle:
+    std::vector<double> v(nbins, 0.0);
+    double vsum(0.0);
+    for(uint32_t b = 1; b < nbins; ++b) {
+      v[b] = std::max(0.0, 1.0 - fabs(log2(b * df / f)) * bpo);
+      vsum += v[b];
+    }
+    if(vsum <= 0.0) {
+      ++ninterp;
+      double p(f / df);
+      uint32_t bl(p);
+      v.assign(nbins, 0.0);
+      v[bl] = 1.0 - (p - bl);
+      v[bl + 1] = p - bl;
+      vsum = 1.0;
+    }
+    double err(0.0);
+    for(uint32_t b = 0; b < nbins; ++b)
+      err = std::max(err, fabs(w[k][b] - v[b] / vsum));
+    check(err < 1e-5, "constant-Q kernel weights");
+  }
+  std::cout << "constant-Q: " << cq.size() << " bands, " << ninterp
+            << " interpolated" << std::endl;
+}
+
+/*
+  Block API of gammatone_bank_t versus per-sample gammatone_t, with
+  noise input and a block size which is not a multiple of the chunk
+  size.
+*/
+void test_block_vs_single(double fs)
+{
+  std::vector<float> f(HoS::logfreqs(50.0f, 12000.0f, 1.0f));
+  std::vector<float> bw;
+  for(auto v : f)
+    bw.push_back(HoS::erb(v));
+  const uint32_t order(4);
+  const uint32_t n(100);
+  HoS::gammatone_bank_t gt(f, bw, fs, order);
+  std::vector<gammatone_t> gt1;
+  for(uint32_t k = 0; k < f.size(); ++k)
+    gt1.push_back(gammatone_t(f[k], bw[k], fs, order));
+  std::vector<float> buf(2 * f.size() * n);
+  std::vector<float*> out_re(f.size());
+  std::vector<float*> out_im(f.size());
+  for(uint32_t k = 0; k < f.size(); ++k) {
+    out_re[k] = &(buf[2 * k * n]);
+    out_im[k] = &(buf[(2 * k + 1) * n]);
+  }
+  std::mt19937 gen(1);
+  std::uniform_real_distribution<float> d_sym(-1.0f, 1.0f);
+  std::vector<float> in(n);
+  double err(0.0);
+  double ymax(0.0);
+  for(uint32_t b = 0; b < 100; ++b) {
+    for(auto& v : in)
+      v = d_sym(gen);
+    gt.process(in.data(), n, out_re.data(), out_im.data());
+    for(uint32_t k = 0; k < f.size(); ++k)
+      for(uint32_t t = 0; t < n; ++t) {
+        std::complex<float> y(gt1[k].filter(in[t]));
+        err = std::max(err, (double)std::abs(
+                                y - std::complex<float>(out_re[k][t],
+                                                        out_im[k][t])));
+        ymax = std::max(ymax, (double)std::abs(y));
+      }
+  }
+  std::cout << "gammatone block versus single band: max error " << err
+            << " (max output " << ymax << ")" << std::endl;
+  check(err < 1e-4 * ymax, "gammatone block API differs from gammatone_t");
+}
+
+/*
+  Run time of a 64-band, 4th order gammatone bank.
+*/
+void bench_gammatone(double fs)
+{
+  std::vector<float> f(HoS::logfreqs(50.0f, 12000.0f, 8.0f));
+  std::vector<float> bw;
+  for(auto v : f)
+    bw.push_back(HoS::erb(v));
+  HoS::gammatone_bank_t gt(f, bw, fs, 4);
+  const uint32_t NTOTAL(1 << 20);
+  std::mt19937 gen(1);
+  std::uniform_real_distribution<float> d_sym(-1.0f, 1.0f);
+  for(uint32_t n : {64u, 256u, 1024u}) {
+    std::vector<float> in(n);
+    for(auto& v : in)
+      v = d_sym(gen);
+    std::vector<float> buf(2 * f.size() * n);
+    std::vector<float*> out_re(f.size());
+    std::vector<float*> out_im(f.size());
+    for(uint32_t k = 0; k < f.size(); ++k) {
+      out_re[k] = &(buf[2 * k * n]);
+      out_im[k] = &(buf[(2 * k + 1) * n]);
+    }
+    TASCAR::wave_t w(n, in.data());
+    const uint32_t nblocks(NTOTAL / n);
+    tclock_t::time_point t0(tclock_t::now());
+    for(uint32_t b = 0; b < nblocks; ++b)
+      gt.process(in.data(), n, out_re.data(), out_im.data());
+    double t_block(ms_since(t0));
+    t0 = tclock_t::now();
+    for(uint32_t b = 0; b < nblocks; ++b)
+      gt.process(w);
+    double t_power(ms_since(t0));
+    // time per second of audio:
+    const double sc(fs / (nblocks * n));
+    std::cout << f.size() << " bands, " << n << " frames, ms per second of "
+              << "audio at " << fs << " Hz:\n"
+              << "  band signals " << t_block * sc << "\n"
+              << "  band powers  " << t_power * sc << std::endl;
+  }
+}
+
+int main(int argc, char** argv)
+{
+  const double fs(48000.0);
+  test_passband(fs);
+  test_constq_kernel(fs);
+  test_block_vs_single(fs);
+  bench_gammatone(fs);
+  if(nfail) {
+    std::cout << nfail << " checks failed." << std::endl;
+    return 1;
+  }
+  std::cout << "All checks passed." << std::endl;
+  return 0;
+}
+
+/*
+ * Local Variables:
+ * mode: c++
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * compile-command: "make -C .."
+ * End:
+ */
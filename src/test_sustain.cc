@@ -0,0 +1,138 @@
+#include "libhos_sustain.h"
+#include <iostream>
+#include <math.h>
+#include <random>
+#include <vector>
+
+/*
+  Checks of the spectral sustain: the live layer fades out when the
+  input stops, a frozen layer keeps its level independent of the
+  input, and a cleared layer fades out with its time constant before
+  its slot is released.
+ */
+
+static uint32_t nfail(0);
+
+void check(bool ok, const std::string& msg)
+{
+  if(!ok) {
+    std::cout << "FAIL: " << msg << std::endl;
+    ++nfail;
+  }
+}
+
+double power(const TASCAR::spec_t& s)
+{
+  double p(0.0);
+  for(uint32_t k = 0; k < s.n_; ++k)
+    p += std::norm(s.b[k]);
+  return p;
+}
+
+double db(double p)
+{
+  return 10.0 * log10(std::max(p, 1e-30));
+}
+
+/*
+  Process frames with the magnitude spectrum mag and random phase,
+  and return the output power of the last frame.
+*/
+double feed(HoS::sustain_spec_t& sus, const std::vector<float>& mag,
+            uint32_t nframes, std::mt19937& gen)
+{
+  std::uniform_real_distribution<float> d_phase(0.0f, 2.0f * M_PI);
+  TASCAR::spec_t s(mag.size());
+  double p(0.0);
+  for(uint32_t f = 0; f < nframes; ++f) {
+    for(uint32_t k = 0; k < s.n_; ++k)
+      s.b[k] = std::polar(mag[k], d_phase(gen));
+    sus.process(s);
+    p = power(s);
+  }
+  return p;
+}
+
+int main(int argc, char** argv)
+{
+  const uint32_t nbins(513);
+  const double frame_rate(48000.0 / 1024.0);
+  const uint32_t nsec(frame_rate);
+  std::mt19937 gen(1);
+  std::uniform_real_distribution<float> d_mag(0.0f, 1.0f);
+  std::vector<float> mag(nbins);
+  double pmag(0.0);
+  for(auto& v : mag) {
+    v = d_mag(gen);
+    pmag += v * v;
+  }
+  const std::vector<float> zero(nbins, 0.0f);
+  // live layer only:
+  {
+    HoS::sustain_spec_t sus(nbins, 1, frame_rate);
+    sus.tau_sustain = 1.0f;
+    sus.tau_envelope = 0.1f;
+    double p_on(feed(sus, mag, 10 * nsec, gen));
+    double p_off(feed(sus, zero, 2 * nsec, gen));
+    std::cout << "live layer: " << db(p_on / pmag) << " dB during input, "
+              << db(p_off / pmag) << " dB 2 s after input" << std::endl;
+    check(fabs(db(p_on / pmag)) < 0.1, "live layer level during input");
+    check(db(p_off / pmag) < -40.0, "live layer does not fade out");
+  }
+  // frozen layer:
+  {
+    HoS::sustain_spec_t sus(nbins, 1, frame_rate);
+    sus.tau_sustain = 0.1f;
+    sus.tau_envelope = 0.1f;
+    HoS::layer_t& layer(*(sus.layers[0]));
+    layer.tau = 0.1f;
+    layer.gain = 0.5f;
+    feed(sus, mag, 10 * nsec, gen);
+    layer.b_freeze = true;
+    feed(sus, mag, 2 * nsec, gen);
+    double p_frozen(feed(sus, zero, 10 * nsec, gen));
+    double p_exp(layer.gain * layer.gain * pmag);
+    std::cout << "frozen layer: " << db(p_frozen / p_exp)
+              << " dB re expected, 10 s after input" << std::endl;
+    check(fabs(db(p_frozen / p_exp)) < 0.1,
+          "frozen layer does not keep its level");
+    // clear:
+    layer.tau = 0.5f;
+    layer.b_clear = true;
+    double p_clear(feed(sus, zero, 1, gen));
+    std::cout << "cleared layer: " << db(p_clear / p_frozen)
+              << " dB in first frame after clear" << std::endl;
+    check(p_clear > 0.5 * p_frozen, "cleared layer does not fade out");
+    check(layer.b_valid, "cleared layer released before fade out");
+    double p_last(p_clear);
+    bool b_mono(true);
+    uint32_t nfade(1);
+    while(layer.b_valid && (nfade < 60 * nsec)) {
+      double p(feed(sus, zero, 1, gen));
+      b_mono = b_mono && (p <= p_last);
+      p_last = p;
+      ++nfade;
+    }
+    std::cout << "cleared layer: released after " << nfade / frame_rate
+              << " s" << std::endl;
+    check(b_mono, "fade out of cleared layer is not monotonic");
+    check(!layer.b_valid, "cleared layer not released");
+    check(feed(sus, zero, 1, gen) < 1e-8 * p_frozen,
+          "released layer still sounding");
+  }
+  if(nfail) {
+    std::cout << nfail << " checks failed." << std::endl;
+    return 1;
+  }
+  std::cout << "All checks passed." << std::endl;
+  return 0;
+}
+
+/*
+ * Local Variables:
+ * mode: c++
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * compile-command: "make -C .."
+ * End:
+ */
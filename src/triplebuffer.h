@@ -0,0 +1,88 @@
+/**
+   \file triplebuffer.h
+   \brief Lock-free triple buffer
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+  USA.
+
+*/
+#ifndef TRIPLEBUFFER_H
+#define TRIPLEBUFFER_H
+
+#include <atomic>
+#include <stdint.h>
+
+namespace HoS {
+
+  /**
+     \brief Lock-free triple buffer for one writer and one reader
+     thread
+
+     The writer fills the write buffer and publishes it; the reader
+     always gets the most recently published buffer. Neither side
+     blocks, and a buffer is never modified while the reader uses it.
+   */
+  template <class T> class triple_buffer_t {
+  public:
+    /**
+       \param init Initial value of all three buffers
+    */
+    triple_buffer_t(const T& init)
+        : buf{init, init, init}, middle(1), back(2), front(0){};
+    /**
+       \brief Buffer to be filled (writer thread only)
+    */
+    T& write_buffer() { return buf[back]; };
+    /**
+       \brief Publish the write buffer (writer thread only)
+
+       Afterwards, write_buffer() returns a different buffer with
+       undefined content.
+    */
+    void publish()
+    {
+      back = middle.exchange(back | DIRTY, std::memory_order_acq_rel) & IDX;
+    };
+    /**
+       \brief Most recently published buffer (reader thread only)
+
+       The returned reference is valid until the next call of read().
+    */
+    const T& read()
+    {
+      if(middle.load(std::memory_order_relaxed) & DIRTY)
+        front = middle.exchange(front, std::memory_order_acq_rel) & IDX;
+      return buf[front];
+    };
+
+  private:
+    enum { IDX = 3, DIRTY = 4 };
+    T buf[3];
+    std::atomic<uint8_t> middle;
+    uint8_t back;
+    uint8_t front;
+  };
+
+} // namespace HoS
+
+#endif
+
+/*
+ * Local Variables:
+ * mode: c++
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * compile-command: "make -C .."
+ * End:
+ */